@@ -0,0 +1,87 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+#include "read_catalog.h"
+#include "book_schema.hpp"
+
+/*
+*  Compares read_catalog(), which matches the names with strings, to the same catalog bound with book_schema.
+*/
+
+static const char* bench_filename = "bench_catalog.xml";
+
+static void write_catalog(size_t number_of_books)
+{
+	FILE* fp = std::fopen(bench_filename, "w");
+	if (fp == NULL) {
+		std::cerr << "Failed to create: " << bench_filename << "\n";
+		std::exit(-1);
+	}
+
+	std::fprintf(fp, "<?xml version=\"1.0\"?>\n<catalog>\n");
+	for (size_t i = 0; i < number_of_books; i++) {
+		std::fprintf(fp,
+			"   <book id=\"bk%zu\">\n"
+			"      <author>Gambardella, Matthew</author>\n"
+			"      <title>XML Developer's Guide</title>\n"
+			"      <genre>Computer</genre>\n"
+			"      <price>%zu.95</price>\n"
+			"      <publish_date>2000-10-01</publish_date>\n"
+			"      <description>An in-depth look at creating applications\n"
+			"      with XML.</description>\n"
+			"   </book>\n", i % 1000000, i % 100);
+	}
+	std::fprintf(fp, "</catalog>\n");
+	std::fclose(fp);
+}
+
+template<typename F>
+static double best_of(int runs, F f)
+{
+	double best = 1e30;
+	for (int i = 0; i < runs; i++) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds < best) best = seconds;
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	size_t number_of_books = argc > 1 ? (size_t)std::strtoul(argv[1], NULL, 10) : 100000;
+	int runs = argc > 2 ? std::atoi(argv[2]) : 5;
+
+	write_catalog(number_of_books);
+	std::vector<book_t> catalog(number_of_books);
+
+	size_t count_c = 0, count_bind = 0;
+	double seconds_c = best_of(runs, [&] {
+		count_c = read_catalog(bench_filename, catalog.data(), catalog.size());
+	});
+	double seconds_bind = best_of(runs, [&] {
+		xml_t* xml = xml_fopen(bench_filename);
+		count_bind = 0;
+		xml_bind::read<book_schema>(xml, [&](const book_t& book) {
+			catalog[count_bind++] = book;
+		});
+		xml_close(xml);
+	});
+	std::remove(bench_filename);
+
+	if (count_c != number_of_books || count_bind != number_of_books) {
+		std::cerr << "Read " << count_c << " and " << count_bind << " books, expected " << number_of_books << "\n";
+		return -1;
+	}
+
+	std::printf("books: %zu\n", number_of_books);
+	std::printf("read_catalog: %.3f ms\n", seconds_c * 1000.0);
+	std::printf("xml_bind:     %.3f ms (%.2fx)\n", seconds_bind * 1000.0, seconds_c / seconds_bind);
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+#include "corpus.hpp"
+#include "xml_dom.hpp"
+#include "xml_flat_dom.hpp"
+#include "xml_lazy_dom.hpp"
+
+/*
+*  Compares the load time and the memory per element of xml_dom, xml_flat_dom and xml_lazy_dom on a generated catalog.
+*
+*    bench_dom [megabytes] [runs] [doms]
+*
+*  doms is a list of the DOMs to measure, "xml_flat_dom,dedup" for instance, by default all of them. dedup is
+*  xml_flat_dom with its strings deduplicated.
+*
+*  The memory is what the DOM holds through operator new after it is loaded, the buffers of the tokenizer are not
+*  counted. xml_lazy_dom only loads the root, its memory is mostly the copy of the document that it keeps.
+*/
+
+// The size of a block as the heap sees it, with what it rounds up.
+#if defined(_MSC_VER)
+#include <malloc.h>
+#define heap_block_size(ptr) _msize(ptr)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define heap_block_size(ptr) malloc_size(ptr)
+#else
+#include <malloc.h>
+#define heap_block_size(ptr) malloc_usable_size(ptr)
+#endif
+
+// The replacements are kept out of line, inlined into the containers GCC sees free() on memory from operator new.
+#if defined(__GNUC__)
+#define heap_noinline __attribute__((noinline))
+#else
+#define heap_noinline
+#endif
+
+static size_t heap_size = 0;
+
+heap_noinline void* operator new(size_t size)
+{
+	void* ptr = std::malloc(size);
+	if (ptr == NULL) throw std::bad_alloc();
+	heap_size += heap_block_size(ptr);
+	return ptr;
+}
+
+heap_noinline void operator delete(void* ptr) noexcept
+{
+	if (ptr == NULL) return;
+	heap_size -= heap_block_size(ptr);
+	std::free(ptr);
+}
+
+heap_noinline void operator delete(void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+static const char* bench_filename = "bench_dom.xml";
+
+template<typename Dom, typename... Args>
+static void measure(const char* doms, const char* name, int runs, size_t elements, Args... args)
+{
+	if (doms != NULL && std::strstr(doms, name) == NULL) return;
+	double best = 1e30;
+	size_t bytes = 0;
+	for (int i = 0; i < runs; i++) {
+		size_t before = heap_size;
+		auto start = std::chrono::steady_clock::now();
+		Dom dom(bench_filename, args...);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds < best) best = seconds;
+		bytes = heap_size - before;
+	}
+	std::printf("%-12s %10.3f ms %12zu bytes %8.1f bytes per element\n", name, best * 1000.0, bytes, (double)bytes / elements);
+}
+
+int main(int argc, char** argv)
+{
+	size_t megabytes = argc > 1 ? (size_t)std::strtoul(argv[1], NULL, 10) : 64;
+	int runs = argc > 2 ? std::atoi(argv[2]) : 3;
+	const char* doms = argc > 3 ? argv[3] : NULL;
+
+	if (!corpus::write(corpus::list[0], bench_filename, megabytes * 1000 * 1000)) {
+		std::cerr << "Failed to create: " << bench_filename << "\n";
+		return -1;
+	}
+
+	size_t elements = xml_flat_dom(bench_filename, true).get_node_count();
+	std::printf("catalog: %zu MB, %zu elements\n", megabytes, elements);
+	measure<xml_dom>(doms, "xml_dom", runs, elements);
+	measure<xml_flat_dom>(doms, "xml_flat_dom", runs, elements);
+	measure<xml_flat_dom>(doms, "dedup", runs, elements, true);
+	measure<xml_lazy_dom>(doms, "xml_lazy_dom", runs, elements);
+	std::remove(bench_filename);
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define XML_STATS
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+#include "corpus.hpp"
+#include "counting_allocator.hpp"
+
+/*
+*  Tokenizes the corpora written by xml_corpus with every trim and collapse setting, and prints the results as JSON.
+*
+*    xml_tokenizer_bench [directory] [runs] [output.json]
+*
+*  The time is the best of the runs, the allocations and the peak of the memory that the tokenizer holds are counted
+*  with an allocator, and the peak of the stack, its reallocations and the depth come from xml_get_stats.
+*/
+
+struct result_t {
+	size_t bytes = 0, tokens = 0, allocations = 0, peak = 0;
+	double seconds = 1e30;
+	xml_stats_t stats;
+	std::string error;
+};
+
+static void run(const std::string& filename, int trim, int collapse, result_t& result)
+{
+	counting_allocator counter;
+	xml_allocator_t allocator = counter.get();
+
+	auto start = std::chrono::steady_clock::now();
+	xml_t* xml = xml_fopen_ex(filename.c_str(), &allocator);
+	if (xml == NULL) {
+		result.error = "Failed to open: " + filename;
+		return;
+	}
+	xml_set_trim(xml, trim);
+	xml_set_collapse(xml, collapse);
+
+	size_t tokens = 0;
+	xml_token_t tok;
+	while ((tok = xml_next_token(xml)) != XML_END_DOCUMENT && tok != XML_ERROR) tokens++;
+	if (tok == XML_ERROR) result.error = xml_get_error(xml);
+	xml_get_stats(xml, &result.stats);
+	xml_close(xml);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (seconds < result.seconds) result.seconds = seconds;
+	result.tokens = tokens;
+	result.allocations = counter.allocations;
+	result.peak = counter.peak;
+}
+
+static std::string json_string(const std::string& str)
+{
+	std::string json = "\"";
+	for (char ch : str) {
+		if (ch == '"' || ch == '\\') json += '\\';
+		if ((unsigned char)ch < 0x20) json += ' ';
+		else json += ch;
+	}
+	return json + "\"";
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = argc > 1 ? argv[1] : ".";
+	int runs = argc > 2 ? std::atoi(argv[2]) : 3;
+	if (argc > 3 && std::freopen(argv[3], "w", stdout) == NULL) {
+		std::cerr << "Failed to create: " << argv[3] << "\n";
+		return -1;
+	}
+
+	if (std::printf("{\n  \"runs\": %d,\n  \"buffer_size\": %d,\n  \"results\": [", runs, XML_BUFFER_SIZE) < 0) {
+		std::cerr << "Failed to write the results\n";
+		return -1;
+	}
+	const char* separator = "\n";
+	for (size_t i = 0; i < corpus::count; i++) {
+		std::string filename = corpus::filename(directory, corpus::list[i].name);
+		FILE* fp = std::fopen(filename.c_str(), "rb");
+		if (fp == NULL) {
+			std::cerr << "Missing " << filename << ", write the corpora with xml_corpus first\n";
+			return -1;
+		}
+		long end = std::fseek(fp, 0, SEEK_END) == 0 ? std::ftell(fp) : -1;
+		std::fclose(fp);
+		if (end < 0) {
+			std::cerr << "Failed to get the size of " << filename << "\n";
+			return -1;
+		}
+		size_t bytes = (size_t)end;
+
+		for (int setting = 0; setting < 4; setting++) {
+			int trim = setting >> 1, collapse = setting & 1;
+			result_t result;
+			for (int r = 0; r < runs && result.error.empty(); r++) run(filename, trim, collapse, result);
+
+			std::cerr << corpus::list[i].name << " trim " << trim << " collapse " << collapse << ": "
+				<< bytes / result.seconds / 1e6 << " MB/s\n";
+			int written = std::printf("%s    { \"corpus\": \"%s\", \"trim\": %d, \"collapse\": %d, \"bytes\": %zu, \"tokens\": %zu, "
+				"\"seconds\": %.6f, \"mb_per_s\": %.2f, \"tokens_per_s\": %.0f, \"allocations\": %zu, \"peak_bytes\": %zu, "
+				"\"stack_peak\": %zu, \"stack_grows\": %llu, \"max_depth\": %d, \"references\": %llu, \"error\": %s }",
+				separator, corpus::list[i].name, trim, collapse, bytes, result.tokens, result.seconds,
+				bytes / result.seconds / 1e6, result.tokens / result.seconds, result.allocations, result.peak,
+				result.stats.stack_peak, (unsigned long long)result.stats.stack_grows, result.stats.max_depth,
+				(unsigned long long)result.stats.references, result.error.empty() ? "null" : json_string(result.error).c_str());
+			if (written < 0) {
+				std::cerr << "Failed to write the results\n";
+				return -1;
+			}
+			separator = ",\n";
+		}
+	}
+	if (std::printf("\n  ]\n}\n") < 0 || std::fflush(stdout) != 0 || std::ferror(stdout)) {
+		std::cerr << "Failed to write the results\n";
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "read_catalog.h"
+#include "xml_bind.hpp"
+
+// The book catalog of read_catalog.c, described for xml_bind.
+XML_BIND_FIELD(book_id, book_t, id, "@id");
+XML_BIND_FIELD(book_author, book_t, author, "author");
+XML_BIND_FIELD(book_title, book_t, title, "title");
+XML_BIND_FIELD(book_genre, book_t, genre, "genre");
+XML_BIND_FIELD(book_price, book_t, price, "price");
+XML_BIND_FIELD(book_publish_date, book_t, public_date, "publish_date");
+XML_BIND_FIELD(book_description, book_t, description, "description");
+
+struct book_schema : xml_bind::schema<book_t, book_id, book_author, book_title, book_genre, book_price, book_publish_date, book_description> {
+	static constexpr const char* path() { return "catalog/book"; }
+};
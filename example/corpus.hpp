@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// Synthetic documents for xml_tokenizer_bench, every corpus stresses another part of the tokenizer. The documents are
+// written in records until they reach the size, so the same corpus can be a few MB or a few GB.
+namespace corpus {
+	namespace detail {
+		// Add what fprintf wrote to size, false when it failed.
+		inline bool add(size_t& size, int written) {
+			if (written < 0) return false;
+			size += (size_t)written;
+			return true;
+		}
+
+		inline bool catalog(FILE* fp, size_t i, size_t& size) {
+			return add(size, std::fprintf(fp,
+				"   <book id=\"bk%zu\">\n"
+				"      <author>Gambardella, Matthew</author>\n"
+				"      <title>XML Developer's Guide</title>\n"
+				"      <genre>Computer</genre>\n"
+				"      <price>%zu.95</price>\n"
+				"      <publish_date>2000-10-01</publish_date>\n"
+				"      <description>An in-depth look at creating applications\n"
+				"      with XML.</description>\n"
+				"   </book>\n", i % 1000000, i % 100));
+		}
+
+		inline bool deep(FILE* fp, size_t i, size_t& size) {
+			const int depth = 4096;
+			for (int level = 0; level < depth; level++) {
+				if (!add(size, std::fprintf(fp, "<n%d>", level % 10))) return false;
+			}
+			if (!add(size, std::fprintf(fp, "leaf %zu", i))) return false;
+			for (int level = depth - 1; level >= 0; level--) {
+				if (!add(size, std::fprintf(fp, "</n%d>", level % 10))) return false;
+			}
+			return add(size, std::fprintf(fp, "\n"));
+		}
+
+		inline bool text(FILE* fp, size_t i, size_t& size) {
+			static const char* words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit" };
+			size_t start = size;
+			if (!add(size, std::fprintf(fp, "<text n=\"%zu\">\n", i))) return false;
+			for (size_t word = i; size - start < 4 * 1024 * 1024; word++) {
+				if (!add(size, std::fprintf(fp, (word % 12) == 11 ? "%s\n      " : "%s  ", words[word % 8]))) return false;
+			}
+			return add(size, std::fprintf(fp, "</text>\n"));
+		}
+
+		inline bool attributes(FILE* fp, size_t i, size_t& size) {
+			if (!add(size, std::fprintf(fp, "<row"))) return false;
+			for (int attribute = 0; attribute < 32; attribute++) {
+				if (!add(size, std::fprintf(fp, " attribute%d=\"value %zu of %d\"", attribute, i, attribute))) return false;
+			}
+			return add(size, std::fprintf(fp, "/>\n"));
+		}
+
+		inline bool entities(FILE* fp, size_t i, size_t& size) {
+			return add(size, std::fprintf(fp, "<p>%zu &lt; %zu &amp;&amp; &quot;x&quot; &gt; &apos;y&apos; &#169; &#x20AC; &#x1F600; A&#66;C</p>\n", i, i + 1));
+		}
+
+		inline bool cdata(FILE* fp, size_t i, size_t& size) {
+			return add(size, std::fprintf(fp,
+				"<code lang=\"c\"><![CDATA[\n"
+				"if (a < b && b > c) { printf(\"<%zu> & </%zu>\"); }\n"
+				"]]></code>\n", i, i));
+		}
+
+		inline bool preserve(FILE* fp, size_t i, size_t& size) {
+			return add(size, std::fprintf(fp,
+				"<pre xml:space=\"preserve\">\n"
+				"    line %zu\n"
+				"        indented   by   spaces\n"
+				"\t\ttabs\t\tand  <b> bold </b>  text\n"
+				"</pre>\n"
+				"<p>   collapsed    text   %zu   </p>\n", i, i));
+		}
+	}
+
+	struct info {
+		const char* name;
+		const char* description;
+		// Write record i and add its bytes to size, false when a write failed.
+		bool (*record)(FILE* fp, size_t i, size_t& size);
+	};
+
+	static const info list[] = {
+		{ "catalog", "book records as in book_catalog.xml", detail::catalog },
+		{ "deep", "elements nested 4096 deep", detail::deep },
+		{ "text", "text nodes of 4 MB", detail::text },
+		{ "attributes", "tags with 32 attributes", detail::attributes },
+		{ "entities", "text dense with entity and character references", detail::entities },
+		{ "cdata", "CDATA sections with markup in them", detail::cdata },
+		{ "preserve", "indented regions with xml:space=\"preserve\"", detail::preserve },
+	};
+
+	static const size_t count = sizeof(list) / sizeof(list[0]);
+
+	inline std::string filename(const std::string& directory, const char* name) {
+		return directory + "/" + name + ".xml";
+	}
+
+	// Write the corpus to the file in records, until it is at least size bytes. Returns false on failure.
+	inline bool write(const info& corpus, const std::string& filename, size_t size) {
+		FILE* fp = std::fopen(filename.c_str(), "wb");
+		if (fp == nullptr) return false;
+
+		size_t written = 0;
+		bool ok = detail::add(written, std::fprintf(fp, "<?xml version=\"1.0\"?>\n<%s>\n", corpus.name));
+		for (size_t i = 0; ok && (written < size || i == 0); i++) ok = corpus.record(fp, i, written);
+		ok = ok && detail::add(written, std::fprintf(fp, "</%s>\n", corpus.name)) && std::ferror(fp) == 0;
+		return std::fclose(fp) == 0 && ok;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdlib>
+
+#include "../xml_tokenizer.h"
+
+// An allocator for xml_fopen_ex, xml_open_reader_ex and xml_open_memory_ex that counts the calls to it and the
+// memory that the tokenizer holds.
+//
+//	counting_allocator counter;
+//	xml_allocator_t allocator = counter.get();
+//	xml_t* xml = xml_fopen_ex("book_catalog.xml", &allocator);
+struct counting_allocator {
+	size_t allocations = 0, size = 0, peak = 0;
+
+	// Every block starts with its size, so deallocate knows how much is given back.
+	static const size_t header = 16;
+
+	xml_allocator_t get() {
+		xml_allocator_t allocator = { this, reallocate, deallocate };
+		return allocator;
+	}
+
+	static void* reallocate(void* context, void* ptr, size_t size) {
+		counting_allocator* counter = (counting_allocator*)context;
+		size_t old_size = 0;
+		if (ptr != NULL) {
+			ptr = (char*)ptr - header;
+			old_size = *(size_t*)ptr;
+		}
+		void* block = std::realloc(ptr, size + header);
+		if (block == NULL) return NULL;
+
+		*(size_t*)block = size;
+		counter->allocations++;
+		counter->size += size - old_size;
+		if (counter->size > counter->peak) counter->peak = counter->size;
+		return (char*)block + header;
+	}
+
+	static void deallocate(void* context, void* ptr) {
+		counting_allocator* counter = (counting_allocator*)context;
+		if (ptr == NULL) return;
+		ptr = (char*)ptr - header;
+		counter->size -= *(size_t*)ptr;
+		std::free(ptr);
+	}
+};
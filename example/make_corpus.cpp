@@ -0,0 +1,35 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "corpus.hpp"
+
+/*
+*  Writes the corpora of xml_tokenizer_bench to a directory.
+*
+*    xml_corpus [directory] [megabytes] [catalog megabytes]
+*
+*  Every corpus is about megabytes in size (default 4), except the catalog which is catalog megabytes (by default the
+*  same). The gigabyte catalogs are opt-in, "xml_corpus corpus 16 1024" writes one of 1 GB.
+*/
+
+int main(int argc, char** argv)
+{
+	std::string directory = argc > 1 ? argv[1] : ".";
+	size_t megabytes = argc > 2 ? (size_t)std::strtoul(argv[2], NULL, 10) : 4;
+	size_t catalog_megabytes = argc > 3 ? (size_t)std::strtoul(argv[3], NULL, 10) : megabytes;
+
+	for (size_t i = 0; i < corpus::count; i++) {
+		const corpus::info& info = corpus::list[i];
+		std::string filename = corpus::filename(directory, info.name);
+		size_t size = (i == 0 ? catalog_megabytes : megabytes) * 1000 * 1000;
+
+		std::cerr << "writing " << filename << ", " << info.description << "\n";
+		if (!corpus::write(info, filename, size)) {
+			std::cerr << "Failed to write: " << filename << "\n";
+			return -1;
+		}
+	}
+	return 0;
+}
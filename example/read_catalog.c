@@ -21,6 +21,18 @@ static xml_token_t next_text_token(xml_token_t tok, xml_t* xml)
 	return tok;
 }
 
+// Symbol ids of the names, registered in this order so that they can be used in a switch.
+enum { CATALOG = 1, BOOK, ID, AUTHOR, TITLE, GENRE, PRICE, PUBLISH_DATE, DESCRIPTION };
+
+static const char* names[] = { "catalog", "book", "id", "author", "title", "genre", "price", "publish_date", "description" };
+
+static void copy_view(char* dst, xml_strview_t view, size_t max_len)
+{
+	size_t len = view.len < max_len ? view.len : max_len;
+	memcpy(dst, view.ptr, len);
+	dst[len] = '\0';
+}
+
 size_t read_catalog(const char* catalog_filename, book_t* catalog, size_t max_books)
 {
 	size_t book_index = 0;
@@ -32,46 +44,40 @@ size_t read_catalog(const char* catalog_filename, book_t* catalog, size_t max_bo
 		exit(-1);
 	}
 
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) xml_register_name(test, names[i]);
+
 	for (xml_token_t tok = xml_next_token(test); tok != XML_END_DOCUMENT; )
 	{
-		while (!(tok == XML_END_TAG && strcmp(xml_get_name(test), "catalog") == 0)) {
-			if (tok == XML_START_TAG && strcmp(xml_get_name(test), "book") == 0) {
+		while (!(tok == XML_END_TAG && xml_get_name_id(test) == CATALOG)) {
+			if (tok == XML_START_TAG && xml_get_name_id(test) == BOOK) {
 				book_t book = { 0 };
 
 				// Read the attributes from the book
 				while (tok != XML_END_ATTRIBUTES) {
-					if (tok == XML_ATTRIBUTE && strcmp(xml_get_name(test), "id") == 0) {
-						strncpy(book.id, xml_get_value(test), MAX_ID_STR_LEN);
+					if (tok == XML_ATTRIBUTE && xml_get_name_id(test) == ID) {
+						copy_view(book.id, xml_get_value_view(test), MAX_ID_STR_LEN);
 					}
 					else if (tok == XML_ERROR) panic_parse_xml_failed(test);
 					tok = xml_next_token(test);
 				}
 
 				// Read the for the book
-				while (!(tok == XML_END_TAG && strcmp(xml_get_name(test), "book") == 0)) {
-					if (tok == XML_START_TAG && strcmp(xml_get_name(test), "author") == 0) {
-						tok = next_text_token(tok, test);
-						strncpy(book.author, xml_get_text(test), MAX_AUTHOR_STR_LEN);
-					}
-					else if (tok == XML_START_TAG && strcmp(xml_get_name(test), "title") == 0) {
-						tok = next_text_token(tok, test);
-						strncpy(book.title, xml_get_text(test), MAX_TITLE_STR_LEN);
-					}
-					else if (tok == XML_START_TAG && strcmp(xml_get_name(test), "genre") == 0) {
-						tok = next_text_token(tok, test);
-						strncpy(book.genre, xml_get_text(test), MAX_GENRE_STR_LEN);
-					}
-					else if (tok == XML_START_TAG && strcmp(xml_get_name(test), "price") == 0) {
-						tok = next_text_token(tok, test);
-						strncpy(book.price, xml_get_text(test), MAX_PRICE_STR_LEN);
-					}
-					else if (tok == XML_START_TAG && strcmp(xml_get_name(test), "publish_date") == 0) {
-						tok = next_text_token(tok, test);
-						strncpy(book.public_date, xml_get_text(test), MAX_PUBLIC_DATA_STR_LEN);
-					}
-					else if (tok == XML_START_TAG && strcmp(xml_get_name(test), "description") == 0) {
-						tok = next_text_token(tok, test);
-						strncpy(book.description, xml_get_text(test), MAX_DESCRIPTION_STR_LEN);
+				while (!(tok == XML_END_TAG && xml_get_name_id(test) == BOOK)) {
+					if (tok == XML_START_TAG) {
+						char* dst = NULL;
+						size_t max_len = 0;
+						switch (xml_get_name_id(test)) {
+						case AUTHOR: dst = book.author; max_len = MAX_AUTHOR_STR_LEN; break;
+						case TITLE: dst = book.title; max_len = MAX_TITLE_STR_LEN; break;
+						case GENRE: dst = book.genre; max_len = MAX_GENRE_STR_LEN; break;
+						case PRICE: dst = book.price; max_len = MAX_PRICE_STR_LEN; break;
+						case PUBLISH_DATE: dst = book.public_date; max_len = MAX_PUBLIC_DATA_STR_LEN; break;
+						case DESCRIPTION: dst = book.description; max_len = MAX_DESCRIPTION_STR_LEN; break;
+						}
+						if (dst != NULL) {
+							tok = next_text_token(tok, test);
+							copy_view(dst, xml_get_text_view(test), max_len);
+						}
 					}
 					else if (tok == XML_ERROR) panic_parse_xml_failed(test);
 					tok = xml_next_token(test);
@@ -0,0 +1,273 @@
+#pragma once
+
+#include "../xml_tokenizer.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+// Binds the elements of a document to a struct. A field is described with a path, the name of a child element of
+// the record ("author") or an attribute of the record ("@id"), and a member. The field names are put into a
+// perfect hash at compile time, so every tag is matched with one hash and one compare.
+//
+//	XML_BIND_FIELD(book_id, book_t, id, "@id");
+//	XML_BIND_FIELD(book_title, book_t, title, "title");
+//
+//	struct book_schema : xml_bind::schema<book_t, book_id, book_title> {
+//		static constexpr const char* path() { return "catalog/book"; }
+//	};
+//
+//	xml_bind::read<book_schema>(xml, [](const book_t& book) { ... });
+namespace xml_bind {
+	namespace detail {
+		constexpr uint32_t no_seed = 0xffffffffu;
+
+		constexpr uint32_t hash_init(uint32_t seed) {
+			return 2166136261u ^ (seed * 0x9e3779b9u);
+		}
+
+		constexpr uint32_t hash_step(uint32_t hash, char ch) {
+			return (hash ^ (uint8_t)ch) * 16777619u;
+		}
+
+		constexpr uint32_t hash_mix(uint32_t hash) {
+			return hash ^ (hash >> 15);
+		}
+
+		constexpr uint32_t hash_str(const char* str, uint32_t hash) {
+			return *str == '\0' ? hash_mix(hash) : hash_str(str + 1, hash_step(hash, *str));
+		}
+
+		constexpr size_t length(const char* str) {
+			return *str == '\0' ? 0 : 1 + length(str + 1);
+		}
+
+		constexpr uint32_t slot_of(const char* name, uint32_t seed, uint32_t mask) {
+			return hash_str(name, hash_init(seed)) & mask;
+		}
+
+		constexpr bool collides_with(const char* const* names, size_t count, uint32_t seed, uint32_t mask, size_t i, size_t j) {
+			return j >= count ? false : slot_of(names[i], seed, mask) == slot_of(names[j], seed, mask) || collides_with(names, count, seed, mask, i, j + 1);
+		}
+
+		constexpr bool collides(const char* const* names, size_t count, uint32_t seed, uint32_t mask, size_t i) {
+			return i >= count ? false : collides_with(names, count, seed, mask, i, i + 1) || collides(names, count, seed, mask, i + 1);
+		}
+
+		// Bisect the range of seeds, so the depth of the recursion stays at log2 of the range.
+		constexpr uint32_t find_seed(const char* const* names, size_t count, uint32_t mask, uint32_t lo, uint32_t hi);
+
+		constexpr uint32_t find_seed_or(uint32_t seed, const char* const* names, size_t count, uint32_t mask, uint32_t lo, uint32_t hi) {
+			return seed != no_seed ? seed : find_seed(names, count, mask, lo, hi);
+		}
+
+		constexpr uint32_t find_seed(const char* const* names, size_t count, uint32_t mask, uint32_t lo, uint32_t hi) {
+			return hi - lo == 1
+				? (collides(names, count, lo, mask, 0) ? no_seed : lo)
+				: find_seed_or(find_seed(names, count, mask, lo, lo + (hi - lo) / 2), names, count, mask, lo + (hi - lo) / 2, hi);
+		}
+
+		constexpr int field_in_slot(const char* const* names, size_t count, uint32_t seed, uint32_t mask, uint32_t slot, size_t i) {
+			return i >= count ? -1 : slot_of(names[i], seed, mask) == slot ? (int)i : field_in_slot(names, count, seed, mask, slot, i + 1);
+		}
+
+		constexpr size_t table_size(size_t count, size_t size) {
+			return size >= count * 2 ? size : table_size(count, size * 2);
+		}
+
+		template<size_t... I> struct indices {};
+		template<size_t N, size_t... I> struct make_indices : make_indices<N - 1, N - 1, I...> {};
+		template<size_t... I> struct make_indices<0, I...> { typedef indices<I...> type; };
+
+		template<typename... Fields>
+		struct names {
+			static constexpr const char* value[sizeof...(Fields)] = { Fields::path()... };
+			static constexpr size_t len[sizeof...(Fields)] = { length(Fields::path())... };
+		};
+
+		template<typename... Fields> constexpr const char* names<Fields...>::value[sizeof...(Fields)];
+		template<typename... Fields> constexpr size_t names<Fields...>::len[sizeof...(Fields)];
+
+		template<typename Names, size_t Count, uint32_t Seed, uint32_t Mask, typename Indices>
+		struct slots;
+
+		template<typename Names, size_t Count, uint32_t Seed, uint32_t Mask, size_t... I>
+		struct slots<Names, Count, Seed, Mask, indices<I...>> {
+			static constexpr int value[sizeof...(I)] = { field_in_slot(Names::value, Count, Seed, Mask, (uint32_t)I, 0)... };
+		};
+
+		template<typename Names, size_t Count, uint32_t Seed, uint32_t Mask, size_t... I>
+		constexpr int slots<Names, Count, Seed, Mask, indices<I...>>::value[sizeof...(I)];
+
+		inline bool segment_is(const char* path, int segment, xml_strview_t name) {
+			for (; segment > 0; segment--) {
+				while (*path != '/' && *path != '\0') path++;
+				if (*path == '\0') return false;
+				path++;
+			}
+			size_t len = 0;
+			while (path[len] != '/' && path[len] != '\0') len++;
+			return len == name.len && std::memcmp(path, name.ptr, len) == 0;
+		}
+
+		inline int segment_count(const char* path) {
+			int count = 1;
+			for (; *path != '\0'; path++) if (*path == '/') count++;
+			return count;
+		}
+	}
+
+	template<size_t N>
+	inline void assign(char (&dst)[N], xml_strview_t text) {
+		size_t len = text.len < N - 1 ? text.len : N - 1;
+		std::memcpy(dst, text.ptr, len);
+		dst[len] = '\0';
+	}
+
+	inline void assign(std::string& dst, xml_strview_t text) {
+		dst.assign(text.ptr, text.len);
+	}
+
+	inline void assign(double& dst, xml_strview_t text) {
+		char buffer[64];
+		assign(buffer, text);
+		dst = std::strtod(buffer, nullptr);
+	}
+
+	inline void assign(long& dst, xml_strview_t text) {
+		char buffer[32];
+		assign(buffer, text);
+		dst = std::strtol(buffer, nullptr, 10);
+	}
+
+	inline void assign(int& dst, xml_strview_t text) {
+		long value;
+		assign(value, text);
+		dst = (int)value;
+	}
+
+	template<typename T, typename M, M T::*Member>
+	struct field {
+		static void apply(T& record, xml_strview_t text) {
+			assign(record.*Member, text);
+		}
+	};
+
+	template<typename T, typename... Fields>
+	struct schema {
+		static_assert(sizeof...(Fields) > 0, "A schema needs at least one field.");
+
+		typedef T record_t;
+		typedef detail::names<Fields...> names_t;
+
+		static constexpr size_t count = sizeof...(Fields);
+		static constexpr uint32_t mask = (uint32_t)detail::table_size(count, 2) - 1;
+		static constexpr uint32_t seed = detail::find_seed(names_t::value, count, mask, 0, 1 << 16);
+		static_assert(seed != detail::no_seed, "Failed to find a perfect hash for the field names.");
+
+		typedef detail::slots<names_t, count, seed, mask, typename detail::make_indices<mask + 1>::type> slots_t;
+
+		// Return the field with the name, -1 if there is none.
+		static int find(bool attribute, xml_strview_t name) {
+			uint32_t hash = detail::hash_init(seed);
+			if (attribute) hash = detail::hash_step(hash, '@');
+			for (size_t i = 0; i < name.len; i++) hash = detail::hash_step(hash, name.ptr[i]);
+
+			int field = slots_t::value[detail::hash_mix(hash) & mask];
+			if (field < 0) return -1;
+
+			const char* path = names_t::value[field];
+			size_t len = names_t::len[field];
+			if (attribute) {
+				if (*path != '@') return -1;
+				path++;
+				len--;
+			}
+			return len == name.len && std::memcmp(path, name.ptr, len) == 0 ? field : -1;
+		}
+
+		static void apply(int field, T& record, xml_strview_t text) {
+			static void (*const apply_field[count])(T&, xml_strview_t) = { &Fields::apply... };
+			apply_field[field](record, text);
+		}
+	};
+
+	template<typename T, typename... Fields> constexpr size_t schema<T, Fields...>::count;
+	template<typename T, typename... Fields> constexpr uint32_t schema<T, Fields...>::mask;
+	template<typename T, typename... Fields> constexpr uint32_t schema<T, Fields...>::seed;
+
+	// Read the attributes and child elements of a record, the start tag of the record has been read.
+	template<typename Schema>
+	void read_record(xml_t* xml, typename Schema::record_t& record) {
+		int level = 0, field = -1;
+		for (;;) {
+			switch (xml_next_token(xml)) {
+			case XML_ATTRIBUTE:
+				if (level == 0) {
+					int attribute = Schema::find(true, xml_get_name_view(xml));
+					if (attribute >= 0) Schema::apply(attribute, record, xml_get_value_view(xml));
+				}
+				break;
+			case XML_START_TAG:
+				if (++level == 1) field = Schema::find(false, xml_get_name_view(xml));
+				break;
+			case XML_TEXT:
+				if (level == 1 && field >= 0) {
+					Schema::apply(field, record, xml_get_text_view(xml));
+					field = -1;
+				}
+				break;
+			case XML_END_TAG:
+				if (level-- == 0) return;
+				break;
+			case XML_ERROR:
+				throw std::runtime_error(xml_get_error(xml));
+			case XML_END_DOCUMENT:
+				return;
+			default:
+				break;
+			}
+		}
+	}
+
+	// Read every element at the path of the schema into a record, and call on_record with it.
+	template<typename Schema, typename F>
+	size_t read(xml_t* xml, F on_record) {
+		const char* path = Schema::path();
+		int segments = detail::segment_count(path), depth = 0, matched = 0;
+		size_t count = 0;
+
+		for (xml_token_t tok = xml_next_token(xml); tok != XML_END_DOCUMENT; tok = xml_next_token(xml)) {
+			switch (tok) {
+			case XML_START_TAG:
+				if (matched == depth && detail::segment_is(path, matched, xml_get_name_view(xml))) matched++;
+				depth++;
+				if (matched == segments && depth == segments) {
+					typename Schema::record_t record = typename Schema::record_t();
+					read_record<Schema>(xml, record);
+					on_record(record);
+					count++;
+					depth--;
+					matched--;
+				}
+				break;
+			case XML_END_TAG:
+				depth--;
+				if (matched > depth) matched = depth;
+				break;
+			case XML_ERROR:
+				throw std::runtime_error(xml_get_error(xml));
+			default:
+				break;
+			}
+		}
+		return count;
+	}
+}
+
+#define XML_BIND_FIELD(name, type, member, field_path) \
+	struct name : xml_bind::field<type, decltype(type::member), &type::member> { \
+		static constexpr const char* path() { return field_path; } \
+	}
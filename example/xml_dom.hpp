@@ -2,37 +2,127 @@
 
 #include "../xml_tokenizer.h"
 
+#include <cstdint>
 #include <string>
+#include <cstring>
 #include <vector>
 #include <stdexcept>
 #include <map>
+#include <unordered_map>
 #include <memory>
 
 class xml_dom {
 public:
+	// Tokenizers are kept per thread and reset for the next document, so parsing many small documents does not
+	// allocate a new tokenizer and input buffer for each of them.
+	struct xml_pool {
+		static const size_t max_size = 8;
+
+		static xml_t* acquire(const char* filename) {
+			std::vector<xml_t*>* list = get_list();
+			if (list == nullptr || list->empty()) return xml_fopen(filename);
+
+			xml_t* xml = list->back();
+			list->pop_back();
+			if (xml_reset_file(xml, filename) == 0) {
+				release(xml);
+				return nullptr;
+			}
+			return xml;
+		}
+
+		static void release(xml_t* xml) {
+			std::vector<xml_t*>* list = get_list();
+			if (list == nullptr || list->size() >= max_size) {
+				xml_close(xml);
+				return;
+			}
+			xml_reset(xml, nullptr);
+			list->push_back(xml);
+		}
+
+	private:
+		struct list_t : std::vector<xml_t*> {
+			~list_t() {
+				for (xml_t* xml : *this) xml_close(xml);
+				destroyed() = true;
+			}
+		};
+
+		// A DOM with static or thread storage can outlive the list of its thread, it then opens and closes its
+		// tokenizer without the pool. The flag has no destructor, so it can still be read after the list is gone.
+		static bool& destroyed() {
+			static thread_local bool destroyed = false;
+			return destroyed;
+		}
+
+		static std::vector<xml_t*>* get_list() {
+			if (destroyed()) return nullptr;
+			static thread_local list_t list;
+			return &list;
+		}
+	};
+
 	struct xml_deleter {
 		void operator()(xml_t* xml) const {
-			xml_close(xml);
+			xml_pool::release(xml);
 		}
 	};
 
 	using attribute_t = std::map<std::string, std::string>;
 	using xml_ptr_t = std::unique_ptr<xml_t, xml_deleter>;
 
+	static std::string to_string(xml_strview_t view) {
+		return std::string(view.ptr, view.len);
+	}
+
+	static bool equals(const std::string& str, xml_strview_t view) {
+		return str.size() == view.len && std::memcmp(str.data(), view.ptr, view.len) == 0;
+	}
+
+	// The elements are moved while the tree is built, so an indexed attribute is kept with the path of child indices
+	// from the root to its element, and the paths are turned into pointers when the tree is done.
+	struct index_builder_t {
+		struct entry_t {
+			size_t attribute;
+			std::string value;
+			size_t path_begin, path_end;
+		};
+
+		std::vector<std::string> names;
+		std::vector<uint32_t> path;
+		std::vector<uint32_t> paths;
+		std::vector<entry_t> entries;
+
+		void add(xml_strview_t name, const std::string& value) {
+			for (size_t i = 0; i < names.size(); i++) {
+				if (!equals(names[i], name)) continue;
+				entry_t entry = { i, value, paths.size(), paths.size() + path.size() };
+				entries.push_back(entry);
+				paths.insert(paths.end(), path.begin(), path.end());
+				return;
+			}
+		}
+	};
+
 	struct element_t {
 		element_t() {}
-		element_t(xml_t* xml, std::string name) : m_name(name) {
+		element_t(xml_t* xml, xml_strview_t name, index_builder_t* builder = nullptr) : m_name(to_string(name)) {
 			xml_token_t tok = xml_next_token(xml);
-			while (!(tok == XML_END_TAG && name == xml_get_name(xml))) {
+			while (!(tok == XML_END_TAG && equals(m_name, xml_get_name_view(xml)))) {
 				switch (tok) {
-				case XML_ATTRIBUTE:
-					m_attribute_lookup[xml_get_name(xml)] = xml_get_value(xml);
+				case XML_ATTRIBUTE: {
+					std::string& value = m_attribute_lookup[to_string(xml_get_name_view(xml))] = to_string(xml_get_value_view(xml));
+					if (builder != nullptr) builder->add(xml_get_name_view(xml), value);
 					break;
+				}
 				case XML_START_TAG:
-					m_children.push_back(element_t(xml, xml_get_name(xml)));
+					if (builder != nullptr) builder->path.push_back((uint32_t)m_children.size());
+					m_children.push_back(element_t(xml, xml_get_name_view(xml), builder));
+					if (builder != nullptr) builder->path.pop_back();
 					break;
 				case XML_TEXT:
-					m_text = xml_get_text(xml);
+					m_text = to_string(xml_get_text_view(xml));
 					break;
 				case XML_ERROR:
 					throw std::runtime_error(xml_get_error(xml));
@@ -78,29 +168,39 @@ public:
 
 
 	private:
+		friend class xml_dom;
+
 		std::string m_name;
 		std::string m_text;
 		attribute_t m_attribute_lookup;
 		children_t m_children;
 	};
 
+	// Elements by the value of an indexed attribute, the root is kept as nullptr so the DOM can be moved.
+	using index_t = std::unordered_map<std::string, element_t*>;
+
 private:
 	xml_ptr_t m_xml_ptr;
 	element_t m_root;
 	attribute_t m_declaration_lookup;
+	std::unordered_map<std::string, index_t> m_indexes;
 
 public:
-	xml_dom(const char* filename) : m_xml_ptr(xml_fopen(filename)) {
+	// The attributes in indexed_attributes are indexed by value while the document is parsed, see find_by_attribute.
+	xml_dom(const char* filename, const std::vector<std::string>& indexed_attributes = std::vector<std::string>()) : m_xml_ptr(xml_pool::acquire(filename)) {
 		if (m_xml_ptr == nullptr) throw std::runtime_error(std::string("Failed to open: ") + filename);
 
+		index_builder_t builder;
+		builder.names = indexed_attributes;
+
 		xml_token_t tok = xml_next_token(m_xml_ptr.get());
 		while (tok != XML_END_DOCUMENT) {
 			switch (tok) {
 			case XML_DECLARATION:
-				m_declaration_lookup[xml_get_name(m_xml_ptr.get())] = xml_get_value(m_xml_ptr.get());
+				m_declaration_lookup[to_string(xml_get_name_view(m_xml_ptr.get()))] = to_string(xml_get_value_view(m_xml_ptr.get()));
 				break;
 			case XML_START_TAG:
-				m_root = element_t(m_xml_ptr.get(), xml_get_name(m_xml_ptr.get()));
+				m_root = element_t(m_xml_ptr.get(), xml_get_name_view(m_xml_ptr.get()), builder.names.empty() ? nullptr : &builder);
 				break;
 			case XML_ERROR:
 				throw std::runtime_error(xml_get_error(m_xml_ptr.get()));
@@ -110,6 +210,16 @@ public:
 			}
 			tok = xml_next_token(m_xml_ptr.get());
 		}
+
+		for (const std::string& name : indexed_attributes) m_indexes[name];
+		for (const index_builder_t::entry_t& entry : builder.entries) {
+			element_t* element = nullptr;
+			for (size_t i = entry.path_begin; i < entry.path_end; i++) {
+				element = &(element == nullptr ? m_root : *element).m_children[builder.paths[i]];
+			}
+			// The first element with the value is kept, as with get_first_child
+			m_indexes[builder.names[entry.attribute]].emplace(entry.value, element);
+		}
 	}
 
 	bool has_declaration(std::string name) {
@@ -125,4 +235,14 @@ public:
 	element_t get_root() {
 		return m_root;
 	}
+
+	// Find the first element with the value of an attribute that was indexed when the DOM was made. The element is
+	// not copied, it is valid as long as the DOM. Returns nullptr if no element has the value.
+	element_t* find_by_attribute(std::string name, std::string value) {
+		auto index = m_indexes.find(name);
+		if (index == m_indexes.end()) throw std::runtime_error(std::string("Failed to find index of attribute: ") + name);
+		auto ret = index->second.find(value);
+		if (ret == index->second.end()) return nullptr;
+		return ret->second != nullptr ? ret->second : &m_root;
+	}
 };
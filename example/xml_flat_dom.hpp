@@ -0,0 +1,297 @@
+#pragma once
+
+#include "xml_dom.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+// A DOM that keeps all elements in one array, linked by index to their first child and next sibling, and all names,
+// values and texts in one arena. Elements are handles and strings are views into the arena, nothing is copied after
+// the document is loaded. Both stay valid as long as the xml_flat_dom.
+//
+// With dedup each distinct name, value and text is stored once and repeated ones share its span, which pays off for
+// records that repeat the same names and values. The strings are hashed as they are added, the table of hashes is
+// dropped when the document is loaded.
+//
+//	xml_flat_dom dom("book_catalog.xml");
+//	for (auto book : dom.get_root().get_children()) {
+//		xml_strview_t id = book.get_attribute("id");
+//	}
+class xml_flat_dom {
+public:
+	static const uint32_t none = 0xffffffffu;
+
+	struct span_t {
+		uint32_t offset, len;
+	};
+
+	struct node_t {
+		span_t name, text;
+		uint32_t parent, first_child, next_sibling, first_attribute, attribute_count;
+	};
+
+	struct attribute_t {
+		span_t name, value;
+	};
+
+	class element_t;
+
+	class children_t {
+	public:
+		class iterator {
+		public:
+			iterator(const xml_flat_dom* dom, uint32_t index) : m_dom(dom), m_index(index) {}
+			element_t operator*() const { return element_t(m_dom, m_index); }
+			iterator& operator++() { m_index = m_dom->m_nodes[m_index].next_sibling; return *this; }
+			bool operator!=(const iterator& other) const { return m_index != other.m_index; }
+			bool operator==(const iterator& other) const { return m_index == other.m_index; }
+
+		private:
+			const xml_flat_dom* m_dom;
+			uint32_t m_index;
+		};
+
+		children_t(const xml_flat_dom* dom, uint32_t first) : m_dom(dom), m_first(first) {}
+		iterator begin() const { return iterator(m_dom, m_first); }
+		iterator end() const { return iterator(m_dom, none); }
+		bool empty() const { return m_first == none; }
+
+	private:
+		const xml_flat_dom* m_dom;
+		uint32_t m_first;
+	};
+
+	class element_t {
+	public:
+		element_t() : m_dom(nullptr), m_index(none) {}
+		element_t(const xml_flat_dom* dom, uint32_t index) : m_dom(dom), m_index(index) {}
+
+		bool is_valid() const {
+			return m_index != none;
+		}
+
+		uint32_t get_index() const {
+			return m_index;
+		}
+
+		xml_strview_t get_name() const {
+			return m_dom->view(node().name);
+		}
+
+		xml_strview_t get_text() const {
+			return m_dom->view(node().text);
+		}
+
+		bool has_attribute(const char* name) const {
+			return find_attribute(name) != nullptr;
+		}
+
+		xml_strview_t get_attribute(const char* name) const {
+			const attribute_t* attribute = find_attribute(name);
+			if (attribute == nullptr) throw std::runtime_error(std::string("Failed to get attribute: ") + name);
+			return m_dom->view(attribute->value);
+		}
+
+		element_t get_parent() const {
+			return element_t(m_dom, node().parent);
+		}
+
+		children_t get_children() const {
+			return children_t(m_dom, node().first_child);
+		}
+
+		element_t get_first_child(const char* name) const {
+			for (uint32_t child = node().first_child; child != none; child = m_dom->m_nodes[child].next_sibling) {
+				if (m_dom->equals(m_dom->m_nodes[child].name, name)) return element_t(m_dom, child);
+			}
+			throw std::runtime_error(std::string("Failed to find first element: ") + name);
+		}
+
+	private:
+		const node_t& node() const {
+			return m_dom->m_nodes[m_index];
+		}
+
+		const attribute_t* find_attribute(const char* name) const {
+			const node_t& n = node();
+			for (uint32_t i = 0; i < n.attribute_count; i++) {
+				const attribute_t& attribute = m_dom->m_attributes[n.first_attribute + i];
+				if (m_dom->equals(attribute.name, name)) return &attribute;
+			}
+			return nullptr;
+		}
+
+		const xml_flat_dom* m_dom;
+		uint32_t m_index;
+	};
+
+	xml_flat_dom(const char* filename, bool dedup = false) : m_dedup(dedup) {
+		xml_dom::xml_ptr_t xml(xml_dom::xml_pool::acquire(filename));
+		if (xml == nullptr) throw std::runtime_error(std::string("Failed to open: ") + filename);
+		load(xml.get());
+	}
+
+	// Load the document from a tokenizer that has not read any tokens, the tokenizer is not closed.
+	explicit xml_flat_dom(xml_t* xml, bool dedup = false) : m_dedup(dedup) {
+		load(xml);
+	}
+
+	bool has_declaration(const char* name) const {
+		return find_declaration(name) != nullptr;
+	}
+
+	xml_strview_t get_declaration(const char* name) const {
+		const attribute_t* declaration = find_declaration(name);
+		if (declaration == nullptr) throw std::runtime_error(std::string("Failed to get declaration: ") + name);
+		return view(declaration->value);
+	}
+
+	element_t get_root() const {
+		return element_t(this, m_nodes.empty() ? none : 0);
+	}
+
+	size_t get_node_count() const {
+		return m_nodes.size();
+	}
+
+	// Bytes held by the nodes, attributes and strings.
+	size_t get_memory_size() const {
+		return m_nodes.capacity() * sizeof(node_t) + (m_attributes.capacity() + m_declarations.capacity()) * sizeof(attribute_t)
+			+ m_strings.capacity();
+	}
+
+private:
+	std::vector<node_t> m_nodes;
+	std::vector<attribute_t> m_attributes;
+	std::vector<attribute_t> m_declarations;
+	std::vector<char> m_strings;
+
+	struct pool_slot_t {
+		uint32_t hash;
+		span_t span;
+	};
+
+	bool m_dedup;
+	std::vector<pool_slot_t> m_pool;
+	size_t m_pool_count = 0;
+
+	span_t append_string(xml_strview_t str) {
+		if (m_strings.size() + str.len > none) throw std::runtime_error("The strings of the document exceed 4 GB.");
+		span_t span = { (uint32_t)m_strings.size(), (uint32_t)str.len };
+		m_strings.insert(m_strings.end(), str.ptr, str.ptr + str.len);
+		return span;
+	}
+
+	// FNV-1a
+	static uint32_t hash_string(xml_strview_t str) {
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < str.len; i++) hash = (hash ^ (uint8_t)str.ptr[i]) * 16777619u;
+		return hash;
+	}
+
+	void grow_pool() {
+		std::vector<pool_slot_t> pool(m_pool.empty() ? 1024 : m_pool.size() * 2, pool_slot_t{ 0, { none, 0 } });
+		size_t mask = pool.size() - 1;
+		for (const pool_slot_t& slot : m_pool) {
+			if (slot.span.offset == none) continue;
+			size_t i = slot.hash & mask;
+			while (pool[i].span.offset != none) i = (i + 1) & mask;
+			pool[i] = slot;
+		}
+		m_pool.swap(pool);
+	}
+
+	// Open addressing with linear probing, kept at most half full. The hash is kept in the slot so most strings that
+	// differ are not compared.
+	span_t add_string(xml_strview_t str) {
+		if (!m_dedup) return append_string(str);
+		if ((m_pool_count + 1) * 2 > m_pool.size()) grow_pool();
+		uint32_t hash = hash_string(str);
+		size_t mask = m_pool.size() - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			pool_slot_t& slot = m_pool[i];
+			if (slot.span.offset == none) {
+				slot.hash = hash;
+				slot.span = append_string(str);
+				m_pool_count++;
+				return slot.span;
+			}
+			if (slot.hash == hash && slot.span.len == str.len && std::memcmp(m_strings.data() + slot.span.offset, str.ptr, str.len) == 0) {
+				return slot.span;
+			}
+		}
+	}
+
+	xml_strview_t view(span_t span) const {
+		xml_strview_t str = { m_strings.data() + span.offset, span.len };
+		return str;
+	}
+
+	bool equals(span_t span, const char* str) const {
+		return std::strlen(str) == span.len && std::memcmp(m_strings.data() + span.offset, str, span.len) == 0;
+	}
+
+	const attribute_t* find_declaration(const char* name) const {
+		for (const attribute_t& declaration : m_declarations) {
+			if (equals(declaration.name, name)) return &declaration;
+		}
+		return nullptr;
+	}
+
+	// The elements are added in document order, the open elements and the last child of each are kept on a stack
+	// instead of recursing, so the depth of the document is not limited by the call stack.
+	void load(xml_t* xml) {
+		struct open_t {
+			uint32_t index, last_child;
+		};
+		std::vector<open_t> open;
+
+		for (xml_token_t tok = xml_next_token(xml); tok != XML_END_DOCUMENT; tok = xml_next_token(xml)) {
+			switch (tok) {
+			case XML_DECLARATION: {
+				attribute_t declaration = { add_string(xml_get_name_view(xml)), add_string(xml_get_value_view(xml)) };
+				m_declarations.push_back(declaration);
+				break;
+			}
+			case XML_START_TAG: {
+				if (m_nodes.size() >= none) throw std::runtime_error("The document has too many elements.");
+				if (open.empty() && !m_nodes.empty()) throw std::runtime_error("The document has more than one root.");
+				uint32_t index = (uint32_t)m_nodes.size();
+				node_t node = { add_string(xml_get_name_view(xml)), { 0, 0 }, none, none, none, (uint32_t)m_attributes.size(), 0 };
+				if (!open.empty()) {
+					open_t& parent = open.back();
+					node.parent = parent.index;
+					if (parent.last_child == none) m_nodes[parent.index].first_child = index;
+					else m_nodes[parent.last_child].next_sibling = index;
+					parent.last_child = index;
+				}
+				m_nodes.push_back(node);
+				open_t element = { index, none };
+				open.push_back(element);
+				break;
+			}
+			case XML_ATTRIBUTE: {
+				attribute_t attribute = { add_string(xml_get_name_view(xml)), add_string(xml_get_value_view(xml)) };
+				m_attributes.push_back(attribute);
+				m_nodes[open.back().index].attribute_count++;
+				break;
+			}
+			case XML_TEXT:
+				m_nodes[open.back().index].text = add_string(xml_get_text_view(xml));
+				break;
+			case XML_END_TAG:
+				open.pop_back();
+				break;
+			case XML_ERROR:
+				throw std::runtime_error(xml_get_error(xml));
+			default:
+				break;
+			}
+		}
+		std::vector<pool_slot_t>().swap(m_pool);
+		m_pool_count = 0;
+	}
+};
@@ -0,0 +1,367 @@
+#pragma once
+
+#include "../xml_tokenizer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+// A DOM over a document in memory that only tokenizes an element when it is first asked for its attributes, text or
+// children. Loading the document reads the root and records each child as a stub, its name and where it starts and
+// ends in the document, the tokenizer skips over the content of the children without making tokens of it. When a
+// stub is opened its range of the document is tokenized the same way, one level at a time, so a large document where
+// only a few elements are read costs little more than a scan for tags.
+//
+// Names, values and texts are views into the document when the tokenizer left them as they are, the rest are copied
+// into an arena of the DOM. Both stay valid as long as the xml_lazy_dom, as do the element handles. The DOM is not
+// thread-safe, reading it loads elements.
+//
+// Errors in an element are found when the element is loaded and thrown from the accessor that loaded it. Its range is
+// tokenized on its own, so an element inside xml:space="preserve" is loaded with trim and collapse turned off.
+//
+//	xml_lazy_dom dom("book_catalog.xml");
+//	for (auto book : dom.get_root().get_children()) {
+//		if (book.get_attribute("id") == ...) book.get_first_child("title").get_text();
+//	}
+class xml_lazy_dom {
+public:
+	static const uint32_t none = 0xffffffffu;
+
+	struct node_t {
+		xml_strview_t name, text;
+		size_t begin, end;
+		uint32_t parent, first_child, next_sibling, first_attribute, attribute_count;
+		bool loaded, preserve;
+	};
+
+	struct attribute_t {
+		xml_strview_t name, value;
+	};
+
+	class element_t;
+
+	class children_t {
+	public:
+		class iterator {
+		public:
+			iterator(xml_lazy_dom* dom, uint32_t index) : m_dom(dom), m_index(index) {}
+			element_t operator*() const { return element_t(m_dom, m_index); }
+			iterator& operator++() { m_index = m_dom->m_nodes[m_index].next_sibling; return *this; }
+			bool operator!=(const iterator& other) const { return m_index != other.m_index; }
+			bool operator==(const iterator& other) const { return m_index == other.m_index; }
+
+		private:
+			xml_lazy_dom* m_dom;
+			uint32_t m_index;
+		};
+
+		children_t(xml_lazy_dom* dom, uint32_t first) : m_dom(dom), m_first(first) {}
+		iterator begin() const { return iterator(m_dom, m_first); }
+		iterator end() const { return iterator(m_dom, none); }
+		bool empty() const { return m_first == none; }
+
+	private:
+		xml_lazy_dom* m_dom;
+		uint32_t m_first;
+	};
+
+	class element_t {
+	public:
+		element_t() : m_dom(nullptr), m_index(none) {}
+		element_t(xml_lazy_dom* dom, uint32_t index) : m_dom(dom), m_index(index) {}
+
+		bool is_valid() const {
+			return m_index != none;
+		}
+
+		bool is_loaded() const {
+			return m_dom->m_nodes[m_index].loaded;
+		}
+
+		uint32_t get_index() const {
+			return m_index;
+		}
+
+		xml_strview_t get_name() const {
+			return m_dom->m_nodes[m_index].name;
+		}
+
+		// The source of the element in the document, from '<' of its start tag to '>' of its end tag.
+		xml_strview_t get_source() const {
+			const node_t& n = m_dom->m_nodes[m_index];
+			xml_strview_t source = { m_dom->m_data + n.begin, n.end - n.begin };
+			return source;
+		}
+
+		xml_strview_t get_text() const {
+			return loaded().text;
+		}
+
+		bool has_attribute(const char* name) const {
+			return find_attribute(name) != nullptr;
+		}
+
+		xml_strview_t get_attribute(const char* name) const {
+			const attribute_t* attribute = find_attribute(name);
+			if (attribute == nullptr) throw std::runtime_error(std::string("Failed to get attribute: ") + name);
+			return attribute->value;
+		}
+
+		element_t get_parent() const {
+			return element_t(m_dom, m_dom->m_nodes[m_index].parent);
+		}
+
+		children_t get_children() const {
+			return children_t(m_dom, loaded().first_child);
+		}
+
+		element_t get_first_child(const char* name) const {
+			for (uint32_t child = loaded().first_child; child != none; child = m_dom->m_nodes[child].next_sibling) {
+				if (equals(m_dom->m_nodes[child].name, name)) return element_t(m_dom, child);
+			}
+			throw std::runtime_error(std::string("Failed to find first element: ") + name);
+		}
+
+	private:
+		const node_t& loaded() const {
+			m_dom->load(m_index);
+			return m_dom->m_nodes[m_index];
+		}
+
+		const attribute_t* find_attribute(const char* name) const {
+			const node_t& n = loaded();
+			for (uint32_t i = 0; i < n.attribute_count; i++) {
+				const attribute_t& attribute = m_dom->m_attributes[n.first_attribute + i];
+				if (equals(attribute.name, name)) return &attribute;
+			}
+			return nullptr;
+		}
+
+		xml_lazy_dom* m_dom;
+		uint32_t m_index;
+	};
+
+	// Read the whole file into memory, which the DOM keeps.
+	xml_lazy_dom(const char* filename) {
+		FILE* fp = std::fopen(filename, "rb");
+		if (fp == nullptr) throw std::runtime_error(std::string("Failed to open: ") + filename);
+		char buffer[65536];
+		size_t length;
+		while ((length = std::fread(buffer, 1, sizeof(buffer), fp)) > 0) m_document.insert(m_document.end(), buffer, buffer + length);
+		bool ok = std::ferror(fp) == 0;
+		std::fclose(fp);
+		if (!ok) throw std::runtime_error(std::string("Failed to read: ") + filename);
+		open(m_document.data(), m_document.size());
+	}
+
+	// Use a document in memory, which must outlive the DOM.
+	xml_lazy_dom(const char* data, size_t size) {
+		open(data, size);
+	}
+
+	xml_lazy_dom(const xml_lazy_dom&) = delete;
+	xml_lazy_dom& operator=(const xml_lazy_dom&) = delete;
+
+	bool has_declaration(const char* name) const {
+		return find_declaration(name) != nullptr;
+	}
+
+	xml_strview_t get_declaration(const char* name) const {
+		const attribute_t* declaration = find_declaration(name);
+		if (declaration == nullptr) throw std::runtime_error(std::string("Failed to get declaration: ") + name);
+		return declaration->value;
+	}
+
+	element_t get_root() {
+		return element_t(this, m_nodes.empty() ? none : 0);
+	}
+
+	// Elements known so far, loaded or not.
+	size_t get_node_count() const {
+		return m_nodes.size();
+	}
+
+	size_t get_loaded_count() const {
+		return m_loaded;
+	}
+
+	// Bytes held by the nodes, attributes and copied strings, the document is not counted.
+	size_t get_memory_size() const {
+		return m_nodes.capacity() * sizeof(node_t) + (m_attributes.capacity() + m_declarations.capacity()) * sizeof(attribute_t)
+			+ m_chunks.capacity() * sizeof(m_chunks[0]) + m_chunk_bytes;
+	}
+
+private:
+	static const size_t chunk_size = 65536;
+
+	std::vector<char> m_document;
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+	std::unique_ptr<xml_t, void (*)(xml_t*)> m_xml{ nullptr, xml_close };
+	std::vector<node_t> m_nodes;
+	std::vector<attribute_t> m_attributes;
+	std::vector<attribute_t> m_declarations;
+	std::vector<std::unique_ptr<char[]>> m_chunks;
+	char* m_chunk_ptr = nullptr;
+	size_t m_chunk_left = 0, m_chunk_bytes = 0, m_loaded = 0;
+
+	static bool equals(xml_strview_t view, const char* str) {
+		return std::strlen(str) == view.len && std::memcmp(view.ptr, str, view.len) == 0;
+	}
+
+	// Strings the tokenizer rewrote are on its stack until the next token, those are copied into the arena. The
+	// chunks are never moved, so the views stay valid as more are added.
+	xml_strview_t add_string(xml_strview_t str) {
+		if (str.ptr >= m_data && str.ptr + str.len <= m_data + m_size) return str;
+		if (str.len > m_chunk_left) {
+			size_t size = str.len > chunk_size / 4 ? str.len : chunk_size;
+			m_chunks.emplace_back(new char[size]);
+			m_chunk_bytes += size;
+			m_chunk_ptr = m_chunks.back().get();
+			m_chunk_left = size;
+		}
+		xml_strview_t copy = { m_chunk_ptr, str.len };
+		std::memcpy(m_chunk_ptr, str.ptr, str.len);
+		if (str.len > chunk_size / 4) m_chunk_left = 0;
+		else {
+			m_chunk_ptr += str.len;
+			m_chunk_left -= str.len;
+		}
+		return copy;
+	}
+
+	const attribute_t* find_declaration(const char* name) const {
+		for (const attribute_t& declaration : m_declarations) {
+			if (equals(declaration.name, name)) return &declaration;
+		}
+		return nullptr;
+	}
+
+	// The tokenizer hides xml:space, so the start tag is looked at for it, otherwise it is inherited.
+	bool is_preserved(const node_t& node) const {
+		const char* p = m_data + node.begin + 1 + node.name.len;
+		const char* end = m_data + node.end;
+		while (p < end && *p != '>') {
+			if (*p == '"' || *p == '\'') {
+				const char* close = (const char*)std::memchr(p + 1, *p, end - p - 1);
+				if (close == nullptr) break;
+				p = close + 1;
+			}
+			else if (end - p > 9 && std::memcmp(p, "xml:space", 9) == 0 && (p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\n' || p[-1] == '\r')) {
+				const char* quote = p + 9;
+				while (quote < end && *quote != '"' && *quote != '\'') quote++;
+				return end - quote > 8 && std::memcmp(quote + 1, "preserve", 8) == 0;
+			}
+			else p++;
+		}
+		return node.preserve;
+	}
+
+	void open(const char* data, size_t size) {
+		m_data = data;
+		m_size = size;
+		m_xml.reset(xml_open_memory(data, size));
+		if (m_xml == nullptr) throw std::runtime_error("Failed to open the document.");
+		xml_t* xml = m_xml.get();
+
+		for (xml_token_t tok = xml_next_token(xml); tok != XML_END_DOCUMENT; tok = xml_next_token(xml)) {
+			switch (tok) {
+			case XML_DECLARATION: {
+				attribute_t declaration = { add_string(xml_get_name_view(xml)), add_string(xml_get_value_view(xml)) };
+				m_declarations.push_back(declaration);
+				break;
+			}
+			case XML_START_TAG: {
+				if (!m_nodes.empty()) throw std::runtime_error("The document has more than one root.");
+				xml_strview_t name = xml_get_name_view(xml);
+				node_t root = { add_string(name), { "", 0 }, xml_get_offset(xml) - name.len - 1, size, none, none, none, 0, 0, false, false };
+				m_nodes.push_back(root);
+				read(0, 0);
+				m_nodes[0].end = end_of(0, xml_get_offset(xml));
+				break;
+			}
+			case XML_ERROR:
+				throw std::runtime_error(xml_get_error(xml));
+			default:
+				break;
+			}
+		}
+		if (m_nodes.empty()) throw std::runtime_error("The document has no root.");
+	}
+
+	// The end tag token comes before its padding and '>'.
+	size_t end_of(size_t base, size_t offset) const {
+		const char* gt = (const char*)std::memchr(m_data + base + offset, '>', m_size - base - offset);
+		if (gt == nullptr) throw std::runtime_error("Failed to find the end of an element.");
+		return (size_t)(gt - m_data) + 1;
+	}
+
+	// Tokenize the range of a stub.
+	void load(uint32_t index) {
+		if (m_nodes[index].loaded) return;
+		node_t& node = m_nodes[index];
+		xml_t* xml = m_xml.get();
+		xml_reset_memory(xml, m_data + node.begin, node.end - node.begin);
+		if (is_preserved(node)) {
+			xml_set_trim(xml, 0);
+			xml_set_collapse(xml, 0);
+		}
+		xml_token_t tok = xml_next_token(xml);
+		while (tok == XML_START_DOCUMENT) tok = xml_next_token(xml);
+		if (tok == XML_ERROR) throw std::runtime_error(xml_get_error(xml));
+		if (tok != XML_START_TAG) throw std::runtime_error("Failed to load an element.");
+		read(index, node.begin);
+	}
+
+	// Read the attributes and the text of the element from its start tag to its end tag, its children are added as
+	// stubs and skipped. The offsets of the tokenizer are from base.
+	void read(uint32_t index, size_t base) {
+		xml_t* xml = m_xml.get();
+		bool preserve = is_preserved(m_nodes[index]);
+		uint32_t last_child = none;
+		m_nodes[index].first_child = none;
+		m_nodes[index].first_attribute = (uint32_t)m_attributes.size();
+		m_nodes[index].attribute_count = 0;
+
+		for (xml_token_t tok = xml_next_token(xml); tok != XML_END_TAG; tok = xml_next_token(xml)) {
+			switch (tok) {
+			case XML_ATTRIBUTE: {
+				attribute_t attribute = { add_string(xml_get_name_view(xml)), add_string(xml_get_value_view(xml)) };
+				m_attributes.push_back(attribute);
+				m_nodes[index].attribute_count++;
+				break;
+			}
+			case XML_TEXT:
+				m_nodes[index].text = add_string(xml_get_text_view(xml));
+				break;
+			case XML_START_TAG: {
+				if (m_nodes.size() >= none) throw std::runtime_error("The document has too many elements.");
+				xml_strview_t name = xml_get_name_view(xml);
+				uint32_t child = (uint32_t)m_nodes.size();
+				node_t node = { add_string(name), { "", 0 }, base + xml_get_offset(xml) - name.len - 1, 0, index, none, none, 0, 0, false, preserve };
+				if (!xml_skip_element(xml) || xml_next_token(xml) != XML_END_TAG) {
+					throw std::runtime_error(std::string("Failed to find the end tag of: ") + std::string(name.ptr, name.len));
+				}
+				node.end = end_of(base, xml_get_offset(xml));
+				m_nodes.push_back(node);
+				if (last_child == none) m_nodes[index].first_child = child;
+				else m_nodes[last_child].next_sibling = child;
+				last_child = child;
+				break;
+			}
+			case XML_ERROR:
+				throw std::runtime_error(xml_get_error(xml));
+			case XML_END_DOCUMENT:
+				throw std::runtime_error("The document ended inside an element.");
+			default:
+				break;
+			}
+		}
+		m_nodes[index].loaded = true;
+		m_loaded++;
+	}
+};
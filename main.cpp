@@ -5,6 +5,7 @@
 
 #include "example/read_catalog.h"
 #include "example/xml_dom.hpp"
+#include "example/book_schema.hpp"
 
 int main()
 {
@@ -60,5 +61,32 @@ int main()
 		std::cout << e.what() << "\n";
 	}
 
+	/*
+	*  Example of parse the book catalog with a schema bound at compile time
+	*/
+	std::cout << "\n\n";
+	std::cout << "***********************************************************\n";
+	std::cout << "*                                                         *\n";
+	std::cout << "*   Example of parser the book_catalog.xml using a bind.  *\n";
+	std::cout << "*                                                         *\n";
+	std::cout << "***********************************************************\n\n";
+	try {
+		xml_dom::xml_ptr_t xml(xml_fopen("book_catalog.xml"));
+		if (xml == nullptr) throw std::runtime_error("Failed to open: book_catalog.xml");
+
+		xml_bind::read<book_schema>(xml.get(), [](const book_t& book) {
+			std::cout << "book: " << book.id << "\n";
+			std::cout << "  author: " << book.author << "\n";
+			std::cout << "  title: " << book.title << "\n";
+			std::cout << "  genre: " << book.genre << "\n";
+			std::cout << "  price: " << book.price << "\n";
+			std::cout << "  public_data: " << book.public_date << "\n";
+			std::cout << "  description: " << book.description << "\n";
+		});
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << "\n";
+	}
+
 	return 0;
 }
@@ -0,0 +1,15 @@
+# Runs two builds of the same test and fails when they print something else.
+#
+#   cmake -DFIRST=<program> -DSECOND=<program> -DOUTPUT=<prefix> -P compare_output.cmake
+
+foreach(program FIRST SECOND)
+	execute_process(COMMAND ${${program}} ${OUTPUT}.${program}.txt RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${${program}} failed: ${result}")
+	endif()
+endforeach()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}.FIRST.txt ${OUTPUT}.SECOND.txt RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "${FIRST} and ${SECOND} differ, see ${OUTPUT}.FIRST.txt and ${OUTPUT}.SECOND.txt")
+endif()
@@ -0,0 +1,189 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Count the calls that reach the heap through XML_REALLOC and XML_FREE.
+static size_t heap_calls = 0;
+
+static void* heap_realloc(void* ptr, size_t size)
+{
+	heap_calls++;
+	return std::realloc(ptr, size);
+}
+
+static void heap_free(void* ptr)
+{
+	if (ptr != NULL) heap_calls++;
+	std::free(ptr);
+}
+
+#define XML_REALLOC(context,ptr,size) heap_realloc(ptr,size)
+#define XML_FREE(context,ptr)         heap_free(ptr)
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+#include "../example/counting_allocator.hpp"
+
+/*
+*  Checks that tokenizers make all their allocations through their allocator, and none on the heap in steady state.
+*
+*    test_allocations
+*
+*  Tokenizers opened with the counting allocator on catalogs from memory and from a reader may not call XML_REALLOC
+*  or XML_FREE and must give back all memory on xml_close. Tokenizers opened one after another on an arena that is
+*  reset for every document may not reach the heap at all.
+*
+*  A tokenizer that is reset for the next document makes no allocations once it has read the largest one. It warms up
+*  on a catalog from a reader and from memory, which allocates the input buffer and the buffers of the c-strings of
+*  views, and is then reset for catalogs of up to the same size from memory and from a reader.
+*/
+
+static std::string catalog(size_t books)
+{
+	std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<catalog>\n";
+	for (size_t i = 0; i < books; i++) {
+		xml += "   <book id=\"bk" + std::to_string(i) + "\" lang=\"en\">\n"
+			"      <author>Gambardella, Matthew</author>\n"
+			"      <title>XML &amp; &#x41; Developer's Guide</title>\n"
+			"      <price>" + std::to_string(i % 100) + ".95</price>\n"
+			"      <description>An in-depth look at   creating applications\n"
+			"      <!-- note -->with <![CDATA[<XML>]]>.</description>\n"
+			"   </book>\n";
+	}
+	return xml + "</catalog>\n";
+}
+
+struct memory_reader {
+	const std::string* data;
+	size_t pos;
+
+	static int read(void* context, void* buffer, size_t size, size_t* length) {
+		memory_reader* reader = (memory_reader*)context;
+		size_t len = reader->data->size() - reader->pos;
+		if (len > size) len = size;
+		std::memcpy(buffer, reader->data->data() + reader->pos, len);
+		reader->pos += len;
+		*length = len;
+		return 0;
+	}
+};
+
+// Read every token and every string of the document with the trim and collapse of the setting, returns false on an
+// error.
+static bool read_document(xml_t* xml, int setting)
+{
+	xml_token_t tok;
+	xml_set_trim(xml, setting >> 1);
+	xml_set_collapse(xml, setting & 1);
+	while ((tok = xml_next_token(xml)) != XML_END_DOCUMENT) {
+		switch (tok) {
+		case XML_START_TAG:
+		case XML_END_TAG:
+			xml_get_name(xml);
+			break;
+		case XML_ATTRIBUTE:
+		case XML_DECLARATION:
+			xml_get_name(xml);
+			xml_get_value(xml);
+			break;
+		case XML_TEXT:
+			xml_get_text(xml);
+			break;
+		case XML_ERROR:
+			std::fprintf(stderr, "%s\n", xml_get_error(xml));
+			return false;
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+// Open the i'th document with the allocator, from memory for even and from a reader for odd documents, read it and
+// close it.
+static bool open_and_read(const std::string& document, size_t i, xml_allocator_t* allocator, int setting)
+{
+	memory_reader context = { &document, 0 };
+	xml_reader_t reader = { &context, memory_reader::read, NULL };
+	xml_t* xml = (i % 2 == 0) ? xml_open_memory_ex(document.data(), document.size(), allocator) :
+		xml_open_reader_ex(&reader, allocator);
+	if (xml == NULL) return false;
+	bool ok = read_document(xml, setting);
+	xml_close(xml);
+	return ok;
+}
+
+int main()
+{
+	const size_t largest = 64, documents = 100;
+	static char buffer[256 * 1024];
+	int failed = 0;
+
+	for (int setting = 0; setting < 4; setting++) {
+		// Every allocation goes through the allocator and is freed on xml_close
+		counting_allocator counter;
+		xml_allocator_t allocator = counter.get();
+		std::string document = catalog(largest);
+		size_t heap = heap_calls;
+		for (size_t i = 0; i < 2; i++) {
+			if (!open_and_read(document, i, &allocator, setting)) return -1;
+		}
+		if (heap_calls != heap) {
+			std::fprintf(stderr, "trim %d collapse %d: %zu calls to the heap past the allocator\n", setting >> 1,
+				setting & 1, heap_calls - heap);
+			failed = 1;
+		}
+		if (counter.size != 0) {
+			std::fprintf(stderr, "trim %d collapse %d: %zu bytes not freed\n", setting >> 1, setting & 1, counter.size);
+			failed = 1;
+		}
+
+		// Short-lived tokenizers on an arena never reach the heap
+		xml_arena_t arena;
+		xml_arena_init(&arena, buffer, sizeof(buffer));
+		allocator = xml_arena_allocator(&arena);
+		heap = heap_calls;
+		for (size_t i = 0; i < documents; i++) {
+			document = catalog(1 + i % largest);
+			xml_arena_reset(&arena);
+			if (!open_and_read(document, i, &allocator, setting)) return -1;
+		}
+		if (heap_calls != heap) {
+			std::fprintf(stderr, "trim %d collapse %d: %zu calls to the heap with the arena\n", setting >> 1,
+				setting & 1, heap_calls - heap);
+			failed = 1;
+		}
+
+		// A reset tokenizer stops allocating once it has read the largest document
+		counting_allocator reused;
+		allocator = reused.get();
+		std::string warm_up = catalog(largest);
+		memory_reader warm_up_context = { &warm_up, 0 };
+		xml_reader_t warm_up_reader = { &warm_up_context, memory_reader::read, NULL };
+		xml_t* xml = xml_open_reader_ex(&warm_up_reader, &allocator);
+		if (xml == NULL || !read_document(xml, setting)) return -1;
+		if (!xml_reset_memory(xml, warm_up.data(), warm_up.size()) || !read_document(xml, setting)) return -1;
+
+		size_t allocations = reused.allocations;
+		for (size_t i = 0; i < documents; i++) {
+			document = catalog(1 + i % largest);
+			memory_reader context = { &document, 0 };
+			xml_reader_t reader = { &context, memory_reader::read, NULL };
+
+			bool ok = (i % 2 == 0) ? xml_reset_memory(xml, document.data(), document.size()) != 0 : xml_reset(xml, &reader) != 0;
+			if (!ok || !read_document(xml, setting)) return -1;
+		}
+		if (reused.allocations != allocations) {
+			std::fprintf(stderr, "trim %d collapse %d: %zu allocations after the warm-up\n", setting >> 1, setting & 1,
+				reused.allocations - allocations);
+			failed = 1;
+		}
+		xml_close(xml);
+		if (reused.size != 0) {
+			std::fprintf(stderr, "trim %d collapse %d: %zu bytes not freed\n", setting >> 1, setting & 1, reused.size);
+			failed = 1;
+		}
+	}
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <string.h>
+
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+/*
+*  Checks xml_set_filter against filtering the tokens of the whole document.
+*
+*    test_filter
+*
+*  Every set of paths is applied to every document from memory, from a reader that hands out 3 bytes at a time and
+*  fed with xml_feed in blocks of 5 bytes. The tokens must be those of the whole document that the paths select, as
+*  found by following the paths through the element names of each token. Paths with more than 64 names in all and
+*  malformed paths must be rejected.
+*/
+
+static const char* documents[] = {
+	"<?xml version=\"1.0\"?>\n"
+	"<catalog>\n"
+	"  <book id=\"bk1\" lang=\"en\"><author>Ralls, Kim</author><title>Midnight Rain</title><price>5.95</price></book>\n"
+	"  <book id=\"bk2\"><author>Corets, Eva</author><title lang=\"fr\">Maeve &amp; Ascendant</title>"
+	"<price>5.95</price><!-- note --> </book>\n"
+	"  <magazine id=\"mg1\"><title>Weekly</title><issue id=\"i1\"><price cur=\"EUR\">2.50</price></issue></magazine>\n"
+	"  <book id=\"bk3\"/>\n"
+	"</catalog>\n",
+	"<catalog><shelf id=\"s1\"><book id=\"bk4\"><title><![CDATA[<b>Deep</b>]]></title><price>1.00</price></book>"
+	"</shelf><price>0</price>text<book><title/></book></catalog>",
+	"<a><b><a><b id=\"x\"><c>one</c></b></a></b><c id=\"y\">two</c></a>",
+};
+
+static const char* filters[][4] = {
+	{ "catalog/book/title" },
+	{ "//price" },
+	{ "catalog/*/title" },
+	{ "*" },
+	{ "/catalog/book" },
+	{ "catalog/book/@id" },
+	{ "//@id" },
+	{ "catalog//@id" },
+	{ "catalog//title" },
+	{ "a//b/c" },
+	{ "//b//c" },
+	{ "catalog/book/title", "catalog/magazine", "//@lang" },
+	{ "//price", "catalog/book/@id", "a/*/*/b" },
+	{ "missing" },
+};
+
+#define MAX_TOKENS 512
+#define MAX_STEPS 16
+
+struct token {
+	xml_token_t tok;
+	char name[32];
+	char str[64];
+};
+
+struct step {
+	char name[32];
+	int descendant, attribute;
+};
+
+struct path {
+	struct step steps[MAX_STEPS];
+	int count;
+};
+
+struct chunk_reader {
+	const char* data;
+	size_t len, pos, step;
+};
+
+static int chunk_read(void* context, void* buffer, size_t size, size_t* length)
+{
+	struct chunk_reader* reader = (struct chunk_reader*)context;
+	size_t len = reader->len - reader->pos;
+	if (len > reader->step) len = reader->step;
+	if (len > size) len = size;
+	memcpy(buffer, reader->data + reader->pos, len);
+	reader->pos += len;
+	*length = len;
+	return 0;
+}
+
+/* Read the tokens of the document with the paths as filter, none when paths is NULL. Source 0 is memory, 1 a reader
+*  and 2 xml_feed. */
+static size_t read_tokens(const char* doc, int source, const char* const* paths, size_t count, struct token* tokens)
+{
+	struct chunk_reader context = { doc, strlen(doc), 0, source == 1 ? 3 : 5 };
+	xml_reader_t chunks = { &context, chunk_read, NULL };
+	xml_t* xml = source == 0 ? xml_open_memory(doc, strlen(doc)) : source == 1 ? xml_open_reader(&chunks) : xml_create();
+	size_t n = 0;
+	char block[8];
+	size_t len;
+	xml_token_t tok;
+	if (paths != NULL && !xml_set_filter(xml, paths, count)) {
+		tokens[n].tok = XML_ERROR;
+		snprintf(tokens[n].str, sizeof(tokens[n].str), "xml_set_filter failed");
+		xml_close(xml);
+		return 1;
+	}
+	do {
+		while ((tok = xml_next_token(xml)) == XML_NEED_MORE) {
+			if (chunk_read(&context, block, sizeof(block), &len) != 0 || !xml_feed(xml, block, len, context.pos == context.len)) break;
+		}
+		tokens[n].tok = tok;
+		tokens[n].name[0] = tokens[n].str[0] = '\0';
+		switch (tok) {
+		case XML_START_TAG:
+		case XML_END_TAG:
+			snprintf(tokens[n].name, sizeof(tokens[n].name), "%s", xml_get_name(xml));
+			break;
+		case XML_ATTRIBUTE:
+			snprintf(tokens[n].name, sizeof(tokens[n].name), "%s", xml_get_name(xml));
+			snprintf(tokens[n].str, sizeof(tokens[n].str), "%s", xml_get_value(xml));
+			break;
+		case XML_TEXT:
+			snprintf(tokens[n].str, sizeof(tokens[n].str), "%s", xml_get_text(xml));
+			break;
+		case XML_ERROR:
+			snprintf(tokens[n].str, sizeof(tokens[n].str), "%s", xml_get_error(xml));
+			break;
+		default:
+			break;
+		}
+		n++;
+	} while (tok != XML_END_DOCUMENT && tok != XML_ERROR && tok != XML_NEED_MORE && n < MAX_TOKENS);
+	xml_close(xml);
+	return n;
+}
+
+static void parse_path(const char* str, struct path* path)
+{
+	int descendant = 0;
+	if (str[0] == '/' && str[1] == '/') {
+		descendant = 1;
+		str += 2;
+	}
+	else if (str[0] == '/') str++;
+	path->count = 0;
+	for (;;) {
+		size_t len = strcspn(str, "/");
+		struct step* step = &path->steps[path->count++];
+		step->attribute = str[0] == '@';
+		step->descendant = descendant;
+		snprintf(step->name, sizeof(step->name), "%.*s", (int)(len - step->attribute), str + step->attribute);
+		if (str[len] == '\0') break;
+		str += len + 1;
+		descendant = *str == '/';
+		str += descendant;
+	}
+}
+
+static int step_name(const struct step* step, const char* name)
+{
+	return strcmp(step->name, "*") == 0 || strcmp(step->name, name) == 0;
+}
+
+enum { SKIP, PASS, MATCH };
+
+struct frame {
+	unsigned states[4];
+	int kind;
+};
+
+/* The tokens of the whole document that the paths select. The states of a path are the indices of the steps that the
+*  names from the root to an element may go on with, an element matches when a path has no steps left. */
+static size_t expect_tokens(const struct token* all, size_t count, const char* const* strs, size_t path_count, struct token* tokens)
+{
+	static struct frame frames[64];
+	struct path paths[4];
+	size_t n = 0;
+	int depth = 0, skip = 0;
+	for (size_t p = 0; p < path_count; p++) parse_path(strs[p], &paths[p]);
+
+	for (size_t i = 0; i < count; i++) {
+		struct frame* top = depth > 0 ? &frames[depth - 1] : NULL;
+		if (skip > 0) {
+			if (all[i].tok == XML_START_TAG) skip++;
+			else if (all[i].tok == XML_END_TAG) skip--;
+			continue;
+		}
+		switch (all[i].tok) {
+		case XML_START_TAG: {
+			struct frame* frame = &frames[depth];
+			frame->kind = MATCH;
+			if (top == NULL || top->kind != MATCH) {
+				int live = 0;
+				frame->kind = SKIP;
+				for (size_t p = 0; p < path_count; p++) {
+					unsigned states = top != NULL ? top->states[p] : 1;
+					frame->states[p] = 0;
+					for (int s = 0; s < paths[p].count; s++) {
+						const struct step* step = &paths[p].steps[s];
+						if (!(states & (1u << s))) continue;
+						if (step->descendant) frame->states[p] |= 1u << s;
+						if (!step->attribute && step_name(step, all[i].name)) frame->states[p] |= 1u << (s + 1);
+					}
+					if (frame->states[p] & (1u << paths[p].count)) frame->kind = MATCH;
+					if (frame->states[p] & ((1u << paths[p].count) - 1)) live = 1;
+				}
+				if (frame->kind == SKIP && live) frame->kind = PASS;
+			}
+			if (frame->kind == SKIP) {
+				skip = 1;
+				continue;
+			}
+			depth++;
+			break;
+		}
+		case XML_END_TAG:
+			depth--;
+			break;
+		case XML_ATTRIBUTE:
+			if (top != NULL && top->kind == PASS) {
+				int match = 0;
+				for (size_t p = 0; p < path_count; p++) {
+					const struct step* last = &paths[p].steps[paths[p].count - 1];
+					if (last->attribute && (top->states[p] & (1u << (paths[p].count - 1))) && step_name(last, all[i].name)) match = 1;
+				}
+				if (!match) continue;
+			}
+			break;
+		case XML_TEXT:
+			if (top == NULL || top->kind != MATCH) continue;
+			break;
+		case XML_DECLARATION:
+			continue;
+		default:
+			break;
+		}
+		tokens[n++] = all[i];
+	}
+	return n;
+}
+
+static int check_limits(void)
+{
+	static const char* malformed[] = { "", "a//", "@id", "a/@id/b", "a/@", "a///b" };
+	char long_path[4 * 70];
+	const char* paths[2] = { long_path, long_path };
+	int failed = 0;
+	xml_t* xml = xml_open_memory("<a/>", 4);
+
+	// 64 names in one path or in all paths are the most
+	long_path[0] = '\0';
+	for (int i = 0; i < 64; i++) strcat(long_path, i > 0 ? "/a" : "a");
+	if (!xml_set_filter(xml, paths, 1)) {
+		fprintf(stderr, "A path of 64 names was rejected.\n");
+		failed = 1;
+	}
+	strcat(long_path, "/a");
+	if (xml_set_filter(xml, paths, 1)) {
+		fprintf(stderr, "A path of 65 names was accepted.\n");
+		failed = 1;
+	}
+	long_path[33 * 2 - 1] = '\0';
+	if (xml_set_filter(xml, paths, 2)) {
+		fprintf(stderr, "Two paths of 33 names were accepted.\n");
+		failed = 1;
+	}
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+		if (xml_set_filter(xml, &malformed[i], 1)) {
+			fprintf(stderr, "The malformed path \"%s\" was accepted.\n", malformed[i]);
+			failed = 1;
+		}
+	}
+	xml_close(xml);
+	return failed;
+}
+
+int main(void)
+{
+	static const char* sources[] = { "memory", "reader", "xml_feed" };
+	static struct token all[MAX_TOKENS], expected[MAX_TOKENS], filtered[MAX_TOKENS];
+	int failed = check_limits();
+
+	for (size_t d = 0; d < sizeof(documents) / sizeof(documents[0]); d++) {
+		size_t all_count = read_tokens(documents[d], 0, NULL, 0, all);
+		if (all[all_count - 1].tok != XML_END_DOCUMENT) {
+			fprintf(stderr, "document %zu: %s\n", d, all[all_count - 1].str);
+			failed = 1;
+			continue;
+		}
+		for (size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+			size_t path_count = 0;
+			while (path_count < 4 && filters[f][path_count] != NULL) path_count++;
+			size_t expected_count = expect_tokens(all, all_count, filters[f], path_count, expected);
+			for (int source = 0; source < 3; source++) {
+				size_t count = read_tokens(documents[d], source, filters[f], path_count, filtered);
+				size_t i = 0;
+				while (i < count && i < expected_count && filtered[i].tok == expected[i].tok &&
+					strcmp(filtered[i].name, expected[i].name) == 0 && strcmp(filtered[i].str, expected[i].str) == 0) i++;
+				if (i < count || i < expected_count) {
+					fprintf(stderr, "document %zu, %s, filter \"%s\" (%zu paths): token %zu is %d %s %s instead of %d %s %s\n",
+						d, sources[source], filters[f][0], path_count, i, i < count ? (int)filtered[i].tok : -1,
+						i < count ? filtered[i].name : "", i < count ? filtered[i].str : "",
+						i < expected_count ? (int)expected[i].tok : -1, i < expected_count ? expected[i].name : "",
+						i < expected_count ? expected[i].str : "");
+					failed = 1;
+				}
+			}
+		}
+	}
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+/*
+*  Checks xml_skip_element against reading the whole document.
+*
+*    test_skip_element
+*
+*  Every element of every document is skipped in turn after its XML_START_TAG, from memory and from a reader that hands
+*  out 3 bytes at a time. The tokens must be those of the whole document without the ones between the start tag and
+*  the end tag of the element.
+*/
+
+static const char* documents[] = {
+	"<?xml version=\"1.0\"?><a x=\"1\"/>\n",
+	"<?xml version=\"1.0\"?><a/>\n",
+	"<a/>",
+	"<!DOCTYPE a><a x='1' />",
+	"<a><b/><c x=\"1\"/><d x=\"/>\">t</d></a>",
+	"<a x=\"1\"><b y='>'><c/>text &amp; more<d></d></b><e><![CDATA[</e><e/>]]></e></a>",
+	"<a><b>one</b> two <b>three<c><d/></c></b></a>\n",
+	"<a><p xml:space=\"preserve\">  <b> x </b>  </p><q>  y  </q></a>",
+};
+
+#define MAX_TOKENS 256
+
+struct token {
+	xml_token_t tok;
+	char str[64];
+};
+
+struct chunk_reader {
+	const char* data;
+	size_t len, pos;
+};
+
+static int chunk_read(void* context, void* buffer, size_t size, size_t* length)
+{
+	struct chunk_reader* reader = (struct chunk_reader*)context;
+	size_t len = reader->len - reader->pos;
+	if (len > 3) len = 3;
+	if (len > size) len = size;
+	memcpy(buffer, reader->data + reader->pos, len);
+	reader->pos += len;
+	*length = len;
+	return 0;
+}
+
+/* Read the tokens of the document and skip the element of the skip'th XML_START_TAG, none when skip is 0. */
+static size_t read_tokens(const char* doc, int reader, int skip, struct token* tokens)
+{
+	struct chunk_reader context = { doc, strlen(doc), 0 };
+	xml_reader_t chunks = { &context, chunk_read, NULL };
+	xml_t* xml = reader ? xml_open_reader(&chunks) : xml_open_memory(doc, strlen(doc));
+	size_t count = 0;
+	int starts = 0;
+	xml_token_t tok;
+	do {
+		tok = xml_next_token(xml);
+		tokens[count].tok = tok;
+		switch (tok) {
+		case XML_START_TAG:
+		case XML_END_TAG:
+			snprintf(tokens[count].str, sizeof(tokens[count].str), "%s", xml_get_name(xml));
+			break;
+		case XML_TEXT:
+			snprintf(tokens[count].str, sizeof(tokens[count].str), "%s", xml_get_text(xml));
+			break;
+		case XML_ERROR:
+			snprintf(tokens[count].str, sizeof(tokens[count].str), "%s", xml_get_error(xml));
+			break;
+		default:
+			tokens[count].str[0] = '\0';
+			break;
+		}
+		count++;
+		if (tok == XML_START_TAG && ++starts == skip && !xml_skip_element(xml)) {
+			tokens[count].tok = XML_ERROR;
+			snprintf(tokens[count].str, sizeof(tokens[count].str), "xml_skip_element failed");
+			count++;
+			break;
+		}
+	} while (tok != XML_END_DOCUMENT && tok != XML_ERROR && count < MAX_TOKENS);
+	xml_close(xml);
+	return count;
+}
+
+/* The tokens of the whole document without the ones inside the element of the skip'th XML_START_TAG. */
+static size_t expect_tokens(const struct token* all, size_t count, int skip, struct token* tokens)
+{
+	size_t n = 0;
+	int starts = 0, depth = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (depth == 0 || (depth == 1 && all[i].tok == XML_END_TAG)) tokens[n++] = all[i];
+		if (depth > 0) {
+			if (all[i].tok == XML_START_TAG) depth++;
+			else if (all[i].tok == XML_END_TAG) depth--;
+		}
+		else if (all[i].tok == XML_START_TAG && ++starts == skip) depth = 1;
+	}
+	return n;
+}
+
+int main(void)
+{
+	static struct token all[MAX_TOKENS], expected[MAX_TOKENS], skipped[MAX_TOKENS];
+	int failed = 0;
+
+	for (size_t d = 0; d < sizeof(documents) / sizeof(documents[0]); d++) {
+		for (int reader = 0; reader < 2; reader++) {
+			size_t all_count = read_tokens(documents[d], reader, 0, all);
+			if (all[all_count - 1].tok != XML_END_DOCUMENT) {
+				fprintf(stderr, "document %zu: %s\n", d, all[all_count - 1].str);
+				failed = 1;
+				continue;
+			}
+			for (int skip = 1;; skip++) {
+				size_t expected_count = expect_tokens(all, all_count, skip, expected);
+				if (expected_count == all_count) break;
+				size_t count = read_tokens(documents[d], reader, skip, skipped);
+				int same = count == expected_count;
+				for (size_t i = 0; same && i < count; i++) {
+					same = skipped[i].tok == expected[i].tok && strcmp(skipped[i].str, expected[i].str) == 0;
+				}
+				if (!same) {
+					fprintf(stderr, "document %zu, %s, skipping start tag %d: %s\n", d, reader ? "reader" : "memory", skip,
+						skipped[count - 1].tok == XML_ERROR ? skipped[count - 1].str : "other tokens");
+					failed = 1;
+				}
+			}
+		}
+	}
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+/*
+*  Checks that a token cache returns the tokens of its document and that stale and truncated caches are rejected.
+*
+*    test_token_cache
+*
+*  The document is written to test_token_cache.xml in the current directory, its tokens are written to
+*  test_token_cache.tokens with xml_write_tokens for every trim, collapse and lazy setting, and the cache is reopened
+*  with xml_open_tokens and compared with the tokens of the document. The cache must then be rejected after a byte of
+*  the document is changed, after the document grows and after the cache is cut short.
+*/
+
+static const char document[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<catalog>\n"
+	"   <book id=\"bk101\" lang=\"en\">\n"
+	"      <author>Gambardella,   Matthew</author>\n"
+	"      <title>XML &amp; &#x41; Developer's Guide</title>\n"
+	"      <description>An in-depth look at\n\t creating applications <![CDATA[<XML>]]>.</description>\n"
+	"   </book>\n"
+	"   <book id=\"bk102\"><title>Midnight Rain</title><empty/></book>\n"
+	"   <p xml:space=\"preserve\">  kept  </p>\n"
+	"</catalog>\n";
+
+static const char* source = "test_token_cache.xml";
+static const char* cache = "test_token_cache.tokens";
+
+#define MAX_TOKENS 256
+
+struct token {
+	xml_token_t tok;
+	char name[32];
+	char str[64];
+};
+
+static int write_file(const char* filename, const char* data, size_t size)
+{
+	FILE* fp = fopen(filename, "wb");
+	if (fp == NULL) return 0;
+	int ok = fwrite(data, 1, size, fp) == size;
+	return (fclose(fp) == 0) && ok;
+}
+
+/* Read the tokens of a tokenizer and close it, returns 0 if xml is NULL. */
+static size_t read_tokens(xml_t* xml, struct token* tokens)
+{
+	size_t n = 0;
+	xml_token_t tok;
+	if (xml == NULL) return 0;
+	do {
+		tok = xml_next_token(xml);
+		tokens[n].tok = tok;
+		tokens[n].name[0] = tokens[n].str[0] = '\0';
+		switch (tok) {
+		case XML_START_TAG:
+		case XML_END_TAG:
+			snprintf(tokens[n].name, sizeof(tokens[n].name), "%s", xml_get_name(xml));
+			break;
+		case XML_ATTRIBUTE:
+		case XML_DECLARATION:
+			snprintf(tokens[n].name, sizeof(tokens[n].name), "%s", xml_get_name(xml));
+			snprintf(tokens[n].str, sizeof(tokens[n].str), "%s", xml_get_value(xml));
+			break;
+		case XML_TEXT:
+			snprintf(tokens[n].str, sizeof(tokens[n].str), "%s", xml_get_text(xml));
+			break;
+		case XML_ERROR:
+			snprintf(tokens[n].str, sizeof(tokens[n].str), "%s", xml_get_error(xml));
+			break;
+		default:
+			break;
+		}
+		n++;
+	} while (tok != XML_END_DOCUMENT && tok != XML_ERROR && n < MAX_TOKENS);
+	xml_close(xml);
+	return n;
+}
+
+static xml_t* open_source(int setting)
+{
+	xml_t* xml = xml_fopen(source);
+	if (xml != NULL) {
+		xml_set_trim(xml, setting & 1);
+		xml_set_collapse(xml, (setting >> 1) & 1);
+		xml_set_lazy(xml, (setting >> 2) & 1);
+	}
+	return xml;
+}
+
+static int write_cache(int setting)
+{
+	xml_t* xml = open_source(setting);
+	if (xml == NULL) return 0;
+	int ok = xml_write_tokens(xml, source, cache);
+	xml_close(xml);
+	return ok;
+}
+
+/* Open the cache and compare its tokens with those of the document with the setting, the cache must be rejected when
+*  reject is set. */
+static int check_cache(int setting, int reject, const char* what)
+{
+	static struct token expected[MAX_TOKENS], cached[MAX_TOKENS];
+	xml_t* xml = xml_open_tokens(cache, source);
+	if (reject) {
+		if (xml == NULL) return 0;
+		xml_close(xml);
+		fprintf(stderr, "setting %d: the cache was opened %s.\n", setting, what);
+		return 1;
+	}
+	size_t count = read_tokens(xml, cached);
+	size_t expected_count = read_tokens(open_source(setting), expected);
+	size_t i = 0;
+	while (i < count && i < expected_count && cached[i].tok == expected[i].tok &&
+		strcmp(cached[i].name, expected[i].name) == 0 && strcmp(cached[i].str, expected[i].str) == 0) i++;
+	if (count == 0 || i < count || i < expected_count || expected[expected_count - 1].tok != XML_END_DOCUMENT) {
+		fprintf(stderr, "setting %d: token %zu of the cache %s is %d %s %s instead of %d %s %s\n", setting, i, what,
+			i < count ? (int)cached[i].tok : -1, i < count ? cached[i].name : "", i < count ? cached[i].str : "",
+			i < expected_count ? (int)expected[i].tok : -1, i < expected_count ? expected[i].name : "",
+			i < expected_count ? expected[i].str : "");
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	size_t len = sizeof(document) - 1;
+	char* changed = (char*)malloc(len + 1);
+	int failed = 0;
+
+	if (changed == NULL) return -1;
+	for (int setting = 0; setting < 8; setting++) {
+		if (!write_file(source, document, len) || !write_cache(setting)) {
+			fprintf(stderr, "setting %d: failed to write the cache.\n", setting);
+			failed = 1;
+			continue;
+		}
+		failed |= check_cache(setting, 0, "as written");
+
+		// A byte of the document is changed, the size stays the same
+		memcpy(changed, document, len);
+		changed[strstr(document, "Rain") - document] = 'r';
+		if (!write_file(source, changed, len)) return -1;
+		failed |= check_cache(setting, 1, "after the document was changed");
+
+		// The document grows
+		changed[len] = '\n';
+		memcpy(changed, document, len);
+		if (!write_file(source, changed, len + 1)) return -1;
+		failed |= check_cache(setting, 1, "after the document grew");
+
+		// The document is as it was, and the cache is cut short
+		static char data[64 * 1024];
+		FILE* fp = fopen(cache, "rb");
+		size_t size = fp != NULL ? fread(data, 1, sizeof(data), fp) : 0;
+		if (fp != NULL) fclose(fp);
+		if (!write_file(source, document, len) || size == 0) return -1;
+		failed |= check_cache(setting, 0, "after the document was restored");
+		if (!write_file(cache, data, size - 1)) return -1;
+		failed |= check_cache(setting, 1, "cut short by a byte");
+		if (!write_file(cache, data, size / 2)) return -1;
+		failed |= check_cache(setting, 1, "cut in half");
+	}
+
+	// A document with an error writes no cache
+	if (!write_file(source, "<catalog><book></catalog>", 25)) return -1;
+	xml_t* xml = xml_fopen(source);
+	if (xml == NULL || xml_write_tokens(xml, source, cache)) {
+		fprintf(stderr, "A cache was written for a document with an error.\n");
+		failed = 1;
+	}
+	if (xml != NULL) xml_close(xml);
+	FILE* fp = fopen(cache, "rb");
+	if (fp != NULL) {
+		fclose(fp);
+		fprintf(stderr, "The cache of a document with an error was left behind.\n");
+		failed = 1;
+	}
+
+	remove(source);
+	remove(cache);
+	free(changed);
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define XML_TOKENIZER_IMPLEMENTATION
+#include "../xml_tokenizer.h"
+
+/*
+*  Prints the tokens of documents with runs of white-space of many lengths at many offsets, with every trim and
+*  collapse setting, from memory and in blocks of a few bytes from a reader.
+*
+*    test_whitespace [output]
+*
+*  The test is built once with the SIMD kernels and once with XML_NO_SIMD, and compare_output.cmake checks that both
+*  print the same. The runs are up to 65 bytes so they cross the 16 and 32 bytes of the SSE2 and AVX2 kernels.
+*
+*  Built with XML_PARALLEL the documents in memory are tokenized on worker threads, with chunks of 64 bytes so the
+*  elements are spread over many chunks, and compare_output.cmake checks the tokens against the build without.
+*  Built with TEST_FEED the blocks are fed with xml_feed to a tokenizer made with xml_create instead of read.
+*/
+
+static const char white_space[] = { ' ', '\t', '\n', '\r' };
+
+struct document {
+	char data[4096];
+	size_t len;
+};
+
+static void append(struct document* doc, const char* str)
+{
+	size_t len = strlen(str);
+	if (doc->len + len >= sizeof(doc->data)) {
+		fprintf(stderr, "The document is too large.\n");
+		exit(-1);
+	}
+	memcpy(doc->data + doc->len, str, len);
+	doc->len += len;
+}
+
+static void append_ws(struct document* doc, size_t count, size_t seed)
+{
+	char ws[128];
+	size_t i;
+	for (i = 0; i < count && i < sizeof(ws) - 1; i++) ws[i] = white_space[(seed + i * 7 / 3) % 4];
+	ws[i] = '\0';
+	append(doc, ws);
+}
+
+static void make_document(struct document* doc, size_t offset, size_t count)
+{
+	char text[64];
+	doc->len = 0;
+	append(doc, "<r>");
+	memset(text, 'x', offset);
+	text[offset] = '\0';
+	append(doc, text);
+	append_ws(doc, count, offset);
+	append(doc, "word");
+	append_ws(doc, count, offset + 1);
+	append(doc, "&amp;");
+	append_ws(doc, count, offset + 2);
+	append(doc, "<b>");
+	append_ws(doc, count, offset + 3);
+	append(doc, "</b>");
+	append_ws(doc, count, offset + 4);
+	append(doc, "<e a=\"");
+	append_ws(doc, count, offset + 5);
+	append(doc, text);
+	append_ws(doc, count, offset + 6);
+	append(doc, "v\"");
+	append_ws(doc, count, offset + 7);
+	append(doc, "/>");
+	append_ws(doc, count, offset + 8);
+	append(doc, "<p xml:space=\"preserve\">");
+	append_ws(doc, count, offset + 9);
+	append(doc, "kept");
+	append_ws(doc, count, offset + 10);
+	append(doc, "</p><!-- c -->");
+	append_ws(doc, count, offset + 11);
+	append(doc, "<![CDATA[");
+	append_ws(doc, count, offset + 12);
+	append(doc, "]]>");
+	append_ws(doc, count, offset + 13);
+	append(doc, text);
+	append(doc, "</r>");
+	append_ws(doc, count, offset + 14);
+}
+
+struct chunk_reader {
+	const char* data;
+	size_t len, pos, step;
+};
+
+static int chunk_read(void* context, void* buffer, size_t size, size_t* length)
+{
+	struct chunk_reader* reader = (struct chunk_reader*)context;
+	size_t len = reader->len - reader->pos;
+	if (len > reader->step) len = reader->step;
+	if (len > size) len = size;
+	memcpy(buffer, reader->data + reader->pos, len);
+	reader->pos += len;
+	*length = len;
+	return 0;
+}
+
+// Read the next token, feeding the next block when a tokenizer made with xml_create needs more.
+static xml_token_t next_token(xml_t* xml, struct chunk_reader* feed)
+{
+	xml_token_t tok;
+	char block[64];
+	size_t len;
+	while ((tok = xml_next_token(xml)) == XML_NEED_MORE && feed != NULL) {
+		if (chunk_read(feed, block, sizeof(block), &len) != 0 || !xml_feed(xml, block, len, feed->pos == feed->len)) break;
+	}
+	return tok;
+}
+
+static void print_view(FILE* out, xml_strview_t view)
+{
+	fprintf(out, " %zu[", view.len);
+	fwrite(view.ptr, 1, view.len, out);
+	fprintf(out, "]");
+}
+
+static int print_tokens(FILE* out, xml_t* xml, int trim, int collapse, struct chunk_reader* feed)
+{
+	xml_token_t tok;
+	if (xml == NULL) return 0;
+	xml_set_trim(xml, trim);
+	xml_set_collapse(xml, collapse);
+	do {
+		tok = next_token(xml, feed);
+		fprintf(out, "%d", (int)tok);
+		switch (tok) {
+		case XML_START_TAG:
+		case XML_END_TAG:
+		case XML_START_ATTRIBUTES:
+		case XML_END_ATTRIBUTES:
+			print_view(out, xml_get_name_view(xml));
+			break;
+		case XML_ATTRIBUTE:
+		case XML_DECLARATION:
+			print_view(out, xml_get_name_view(xml));
+			print_view(out, xml_get_value_view(xml));
+			break;
+		case XML_TEXT:
+			print_view(out, xml_get_text_view(xml));
+			break;
+		case XML_ERROR:
+			fprintf(out, " %s", xml_get_error(xml));
+			break;
+		default:
+			break;
+		}
+		fprintf(out, "\n");
+	} while (tok != XML_END_DOCUMENT && tok != XML_ERROR && tok != XML_NEED_MORE);
+	xml_close(xml);
+	return tok == XML_END_DOCUMENT;
+}
+
+int main(int argc, char** argv)
+{
+	static const size_t counts[] = { 0, 1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 47, 48, 49, 63, 64, 65 };
+	struct document doc;
+	FILE* out = argc > 1 ? fopen(argv[1], "w") : stdout;
+	int failed = 0;
+
+	if (out == NULL) {
+		fprintf(stderr, "Failed to create: %s\n", argv[1]);
+		return -1;
+	}
+	for (size_t offset = 0; offset <= 33; offset++) {
+		for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+			make_document(&doc, offset, counts[c]);
+			for (int setting = 0; setting < 4; setting++) {
+				int trim = setting >> 1, collapse = setting & 1;
+				struct chunk_reader reader = { doc.data, doc.len, 0, 7 };
+
+				xml_t* xml = xml_open_memory(doc.data, doc.len);
+#ifdef XML_PARALLEL
+				if (xml != NULL && !xml_set_threads(xml, 3)) failed = 1;
+#endif
+				fprintf(out, "offset %zu count %zu trim %d collapse %d memory\n", offset, counts[c], trim, collapse);
+				failed |= !print_tokens(out, xml, trim, collapse, NULL);
+				fprintf(out, "offset %zu count %zu trim %d collapse %d blocks\n", offset, counts[c], trim, collapse);
+#ifdef TEST_FEED
+				failed |= !print_tokens(out, xml_create(), trim, collapse, &reader);
+#else
+				xml_reader_t chunks = { &reader, chunk_read, NULL };
+				failed |= !print_tokens(out, xml_open_reader(&chunks), trim, collapse, NULL);
+#endif
+			}
+		}
+	}
+	if (out != stdout) fclose(out);
+	if (failed) fprintf(stderr, "A document did not reach XML_END_DOCUMENT.\n");
+	return failed ? -1 : 0;
+}
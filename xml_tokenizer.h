@@ -19,16 +19,54 @@
 *      By default the stdlib realloc() and free() is used. You can defines your own by
 *      defining these symbols. You must either define both, or neither.
 *
-*      Note that at the moment, 'context' will always be NULL.
+*      'context' is the context of the allocator given to xml_fopen_ex, xml_open_reader_ex or
+*      xml_open_memory_ex when its functions are NULL, otherwise it is NULL.
 *
-*    #define XML_FOPEN(fp,filename,mode) better_fopen
-*    #define XML_FGETC(fp)               better_fgetc
-*    #define XML_FCLOSE(fp)              better_fclose
+*    #define XML_FOPEN(fp,filename,mode)        better_fopen
+*    #define XML_FREAD(fp,buffer,size,length)   better_fread
+*    #define XML_FCLOSE(fp)                     better_fclose
 *
 *      These defines only need to be set in the file containing XML_TOKENIZER_IMPLEMENTATION
 *
-*      By default the stdlib fopen(), fgetc() and free() is used. You can defines you own
-*      by defining these symbols. You most either define all three, or neither
+*      By default the stdlib fopen(), fread() and fclose() is used. You can defines you own
+*      by defining these symbols. You most either define all three, or neither.
+*      XML_FREAD stores the number of bytes read in 'length' and evaluates to non-zero on
+*      a read error. A 'length' of zero marks the end of the file.
+*
+*    #define XML_BUFFER_SIZE (65536)
+*
+*      Size in bytes of the input buffer that the tokenizer reads the xml file into.
+*
+*    #define XML_GZIP
+*    #define XML_ZSTD
+*
+*      Read files compressed with gzip (zlib, link with -lz) or zstd (link with -lzstd). xml_fopen detects
+*      the compression from the first bytes of the file, see xml_fopen_compressed.
+*
+*    #define XML_NO_MMAP
+*
+*      Leave out xml_open_mmap and xml_open_tokens on platforms without memory mapped files.
+*
+*    #define XML_NO_SIMD
+*
+*      Use the scalar kernels only. By default runs of text and white-space are scanned with SSE2
+*      on x86, or AVX2 when the cpu supports it, which is detected at runtime.
+*
+*    #define XML_PARALLEL
+*    #define XML_PARALLEL_CHUNK_SIZE (4194304)
+*
+*      Build xml_set_threads with worker threads, pthreads or the threads of Windows. The document is split
+*      in chunks of XML_PARALLEL_CHUNK_SIZE bytes for the workers. The allocator must be thread-safe.
+*
+*    #define XML_READ_AHEAD_SIZE (1048576)
+*
+*      Size in bytes of the blocks that xml_set_read_ahead reads on its thread, needs XML_PARALLEL.
+*
+*    #define XML_STATS
+*    #define XML_STATS_CYCLES
+*
+*      Keep the counters of xml_get_stats, without XML_STATS they compile to nothing. XML_STATS_CYCLES also counts
+*      the cpu cycles spent for each type of token, with the time stamp counter of x86.
 *
 *  LICENSE
 * 
@@ -50,9 +88,11 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 	typedef struct xml__impl xml_t;
+	typedef struct xml__symbols xml_symbols_t;
 
 	typedef enum {
 		XML_DECLARATION,
@@ -60,21 +100,205 @@ extern "C" {
 		XML_START_TAG, XML_END_TAG,
 		XML_START_ATTRIBUTES, XML_END_ATTRIBUTES, XML_ATTRIBUTE,
 		XML_TEXT,
-		XML_ERROR
+		XML_ERROR,
+		XML_NEED_MORE
 	} xml_token_t;
 
+	typedef enum {
+		XML_COMPRESSION_AUTO,
+		XML_COMPRESSION_NONE,
+		XML_COMPRESSION_GZIP,
+		XML_COMPRESSION_ZSTD
+	} xml_compression_t;
+
+	typedef struct {
+		void* context;
+		int (*read)(void* context, void* buffer, size_t size, size_t* length);
+		void (*close)(void* context);
+	} xml_reader_t;
+
+	typedef struct {
+		const char* ptr;
+		size_t len;
+	} xml_strview_t;
+
+	typedef struct {
+		xml_token_t token;
+		int depth;
+		xml_strview_t name, value, text;
+		int refs;
+	} xml_token_rec_t;
+
+	typedef struct {
+		void* context;
+		void* (*reallocate)(void* context, void* ptr, size_t size);
+		void (*deallocate)(void* context, void* ptr);
+	} xml_allocator_t;
+
+	typedef struct {
+		uint8_t* buffer;
+		size_t size, used, last;
+	} xml_arena_t;
+
+	typedef struct {
+		uint64_t bytes;
+		uint64_t tokens[XML_NEED_MORE + 1];
+		uint64_t cycles[XML_NEED_MORE + 1];
+		uint64_t references;
+		uint64_t stack_grows;
+		size_t stack_peak;
+		int max_depth;
+	} xml_stats_t;
+
 	/** @brief Open a file reading xml.
 	*   @param filename Name of the xml file.
 	*   @return NULL on failure and a pointer to a xml structure on success.
 	*/
 	xml_t* xml_fopen(const char* filename);
 
+	/** @brief Open a file reading xml, all memory of the tokenizer is allocated with the allocator.
+	*   @param filename Name of the xml file.
+	*   @param allocator Pointer to the allocator, the structure is copied. When its functions are NULL, XML_REALLOC
+	*          and XML_FREE are called with its context.
+	*   @return NULL on failure and a pointer to a xml structure on success.
+	*/
+	xml_t* xml_fopen_ex(const char* filename, const xml_allocator_t* allocator);
+
+	/** @brief Open a compressed xml file, it is decompressed block by block into the input buffer of the tokenizer.
+	*          XML_COMPRESSION_AUTO detects gzip and zstd from the first bytes of the file, as xml_fopen and
+	*          xml_reset_file do, and reads other files as they are. Gzip needs XML_GZIP and zstd needs XML_ZSTD.
+	*          With xml_set_read_ahead the file is decompressed on a thread while the tokenizer runs.
+	*   @param filename Name of the xml file.
+	*   @param compression The compression of the file.
+	*   @param allocator Pointer to the allocator, see xml_fopen_ex.
+	*   @return NULL on failure or if the compression is not compiled in, and a pointer to a xml structure on success.
+	*/
+	xml_t* xml_fopen_compressed(const char* filename, xml_compression_t compression, const xml_allocator_t* allocator);
+
+	/** @brief Start over on a new xml stream with the same tokenizer, the previous source is closed. The memory that
+	*          the tokenizer has allocated is kept, and trim and collapse are enabled as for a new tokenizer.
+	*   @param xml Pointer to the xml structure.
+	*   @param reader Pointer to the reader, the structure is copied. NULL only closes the previous source, a
+	*          tokenizer made with xml_create is then fed the next document with xml_feed.
+	*   @return value > 0 on success.
+	*/
+	int xml_reset(xml_t* xml, const xml_reader_t* reader);
+
+	/** @brief Start over on a xml file with the same tokenizer, see xml_reset.
+	*   @param xml Pointer to the xml structure.
+	*   @param filename Name of the xml file.
+	*   @return value > 0 on success, 0 if the file could not be opened and the tokenizer has no source.
+	*/
+	int xml_reset_file(xml_t* xml, const char* filename);
+
+	/** @brief Start over on a xml document in memory with the same tokenizer, see xml_reset and xml_open_memory.
+	*   @param xml Pointer to the xml structure.
+	*   @param data Pointer to the xml document.
+	*   @param size Size of the document in bytes.
+	*   @return value > 0 on success.
+	*/
+	int xml_reset_memory(xml_t* xml, const char* data, size_t size);
+
+	/** @brief Open a xml stream using a custom reader. The reader fills the tokenizers input buffer in blocks.
+	*          read() shall store the number of bytes read in length, where zero marks the end of the input,
+	*          and return 0 on success or an error code on failure. close() is called by xml_close and may be NULL.
+	*   @param reader Pointer to the reader, the structure is copied.
+	*   @return NULL on failure and a pointer to a xml structure on success.
+	*/
+	xml_t* xml_open_reader(const xml_reader_t* reader);
+
+	/** @brief Open a xml stream using a custom reader and allocator, see xml_open_reader and xml_fopen_ex.
+	*   @param reader Pointer to the reader, the structure is copied.
+	*   @param allocator Pointer to the allocator, the structure is copied.
+	*   @return NULL on failure and a pointer to a xml structure on success.
+	*/
+	xml_t* xml_open_reader_ex(const xml_reader_t* reader, const xml_allocator_t* allocator);
+
+	/** @brief Create a tokenizer that is fed with xml_feed instead of reading from a source, for input that arrives
+	*          in blocks, from a non-blocking socket for instance. When the tokenizer has read everything that has
+	*          been fed it returns XML_NEED_MORE, and the next call after xml_feed goes on from there. The token that
+	*          was cut is tokenized again from its start, so feed blocks of a few KiB rather than bytes.
+	*   @return Pointer to a xml structure.
+	*/
+	xml_t* xml_create(void);
+
+	/** @brief Create a tokenizer that is fed with xml_feed using a custom allocator, see xml_create and xml_fopen_ex.
+	*   @param allocator Pointer to the allocator, the structure is copied.
+	*   @return Pointer to a xml structure.
+	*/
+	xml_t* xml_create_ex(const xml_allocator_t* allocator);
+
+	/** @brief Feed the next block of the document to a tokenizer made with xml_create, the data is copied. After the
+	*          last block the tokenizer reports the end of the input as an error instead of XML_NEED_MORE.
+	*   @param xml Pointer to the xml structure.
+	*   @param data Pointer to the block.
+	*   @param size Size of the block in bytes, may be 0.
+	*   @param is_final Value > 0 if this is the last block of the document.
+	*   @return value > 0 on success, 0 if the tokenizer is not fed or the last block has been fed.
+	*/
+	int xml_feed(xml_t* xml, const void* data, size_t size, int is_final);
+
+	/** @brief Open a xml document that is already in memory. The memory is not copied and must be valid until xml_close.
+	*          Names, values and texts that need no rewrite are returned as views straight into the memory.
+	*   @param data Pointer to the xml document.
+	*   @param size Size of the document in bytes.
+	*   @return NULL on failure and a pointer to a xml structure on success.
+	*/
+	xml_t* xml_open_memory(const char* data, size_t size);
+
+	/** @brief Open a xml document that is already in memory using a custom allocator, see xml_open_memory and xml_fopen_ex.
+	*   @param data Pointer to the xml document.
+	*   @param size Size of the document in bytes.
+	*   @param allocator Pointer to the allocator, the structure is copied.
+	*   @return NULL on failure and a pointer to a xml structure on success.
+	*/
+	xml_t* xml_open_memory_ex(const char* data, size_t size, const xml_allocator_t* allocator);
+
+	/** @brief Open a file reading xml by memory mapping it, see xml_open_memory.
+	*   @param filename Name of the xml file.
+	*   @return NULL on failure and a pointer to a xml structure on success.
+	*/
+	xml_t* xml_open_mmap(const char* filename);
+
+	/** @brief Tokenize a xml file once and write its tokens to a cache file, that xml_open_tokens maps instead of
+	*          tokenizing the file again. Each distinct string is kept once in a table of the cache, with references
+	*          decoded. The header holds the version of the format, the trim and collapse the tokens were made with,
+	*          and the size and checksum of the xml file.
+	*   @param xml Pointer to a tokenizer opened on source that has not read any tokens, it is read to the end.
+	*   @param source Name of the xml file, it is read once more for the checksum.
+	*   @param filename Name of the cache file.
+	*   @return value > 0 on success, 0 if the document has an error or a file could not be read or written.
+	*/
+	int xml_write_tokens(xml_t* xml, const char* source, const char* filename);
+
+	/** @brief Open a cache file written by xml_write_tokens by memory mapping it. xml_next_token returns the tokens
+	*          of the document and the accessors and xml_skip_element work as on the document, the strings are views
+	*          into the mapping. Tokenizing options have no effect, the tokens are as they were written.
+	*   @param filename Name of the cache file.
+	*   @param source Name of the xml file the cache was made from, its size and checksum must match the cache. NULL
+	*          leaves out the check, which reads the whole xml file.
+	*   @return NULL if the cache could not be opened, is of another version or byte order, or is stale, and a
+	*          pointer to a xml structure on success.
+	*/
+	xml_t* xml_open_tokens(const char* filename, const char* source);
+
 	/** @brief Read the next token from the xml input.
 	*   @param xml Pointer to a pointer to the xml structure.
-	*   @return The next token.
+	*   @return The next token, XML_NEED_MORE when a tokenizer made with xml_create has read all that has been fed.
 	*/
 	xml_token_t xml_next_token(xml_t* xml);
 
+	/** @brief Read the next tokens from the xml input into an array, the tokenizer runs without returning until the
+	*          array is full or the document has ended. Each record holds what the accessors would return for the
+	*          token, the message of a XML_ERROR is in text. The views are valid until the next call to
+	*          xml_next_tokens or xml_close, the accessors return the last token of the batch.
+	*   @param xml Pointer to the xml structure.
+	*   @param out Array of records to fill.
+	*   @param max Number of records in out.
+	*   @return Number of records filled, the last one is XML_END_DOCUMENT or XML_ERROR at the end, or XML_NEED_MORE.
+	*/
+	size_t xml_next_tokens(xml_t* xml, xml_token_rec_t* out, size_t max);
+
 	/** @brief Return the name of a tag, can only be read after a XML_DECLARATION, XML_TAG_START, XML_ATTRIBUTE or XML_TAG_END token.
 	*   @param xml Pointer to the xml structure.
 	*   @return String with a name of a tag.
@@ -93,6 +317,115 @@ extern "C" {
 	*/
 	const char* xml_get_text(xml_t* xml);
 
+	/** @brief Return the name as a view, see xml_get_name. The view is not nul-terminated.
+	*   @param xml Pointer to the xml structure.
+	*   @return View of the name, ptr is NULL if there is no name.
+	*/
+	xml_strview_t xml_get_name_view(xml_t* xml);
+
+	/** @brief Return the value as a view, see xml_get_value. The view is not nul-terminated.
+	*   @param xml Pointer to the xml structure.
+	*   @return View of the value, ptr is NULL if there is no value.
+	*/
+	xml_strview_t xml_get_value_view(xml_t* xml);
+
+	/** @brief Return the text as a view, see xml_get_text. The view is not nul-terminated.
+	*   @param xml Pointer to the xml structure.
+	*   @return View of the text, ptr is NULL if there is no text.
+	*/
+	xml_strview_t xml_get_text_view(xml_t* xml);
+
+	/** @brief Return the length of the name in bytes, see xml_get_name.
+	*   @param xml Pointer to the xml structure.
+	*   @return Length of the name, 0 if there is no name.
+	*/
+	size_t xml_get_name_len(xml_t* xml);
+
+	/** @brief Return the length of the value in bytes, see xml_get_value. In lazy mode a value with references is
+	*          decoded first, so the length can be less than that of xml_get_value_view.
+	*   @param xml Pointer to the xml structure.
+	*   @return Length of the value, 0 if there is no value.
+	*/
+	size_t xml_get_value_len(xml_t* xml);
+
+	/** @brief Return the length of the text in bytes, see xml_get_text. In lazy mode a text with references is decoded
+	*          first, so the length can be less than that of xml_get_text_view.
+	*   @param xml Pointer to the xml structure.
+	*   @return Length of the text, 0 if there is no text.
+	*/
+	size_t xml_get_text_len(xml_t* xml);
+
+	/** @brief Return if the value of the last XML_ATTRIBUTE or XML_DECLARATION token, or the text of the last XML_TEXT
+	*          token, still contains entity or character references, which only happens in lazy mode, see xml_set_lazy.
+	*   @param xml Pointer to the xml structure.
+	*   @return value > 0 if the view has to be decoded with xml_decode.
+	*/
+	int xml_has_refs(xml_t* xml);
+
+	/** @brief Decode the entity and character references in a string to utf-8, references that are not valid are
+	*          copied as they are. The result is never longer than the string, so dst can be the same as src.
+	*   @param src The string, it does not have to be nul-terminated.
+	*   @param len Length of the string in bytes.
+	*   @param dst Buffer of at least len bytes for the result, it is not nul-terminated.
+	*   @return Length of the result in bytes.
+	*/
+	size_t xml_decode(const char* src, size_t len, char* dst);
+
+	/** @brief Return the symbol id of the name, so that names can be told apart with a switch instead of comparing
+	*          strings. Names are interned in the tokenizer's own symbol table the first time they are asked for,
+	*          unless a shared table is set with xml_set_symbols.
+	*   @param xml Pointer to the xml structure.
+	*   @return Symbol id > 0, 0 if there is no name or the name is not in a shared table.
+	*/
+	int xml_get_name_id(xml_t* xml);
+
+	/** @brief Register a name ahead of the document in the symbol table the tokenizer uses, ids are given out in
+	*          order from 1, so the names of an enum can be registered in the order of the enum.
+	*   @param xml Pointer to the xml structure.
+	*   @param name The name.
+	*   @return Symbol id of the name.
+	*/
+	int xml_register_name(xml_t* xml, const char* name);
+
+	/** @brief Use a symbol table that is shared with other tokenizers instead of the tokenizer's own. A shared table
+	*          is only read by the tokenizer, names that are not added to it get id 0, so a table with all names
+	*          added can be used from several threads.
+	*   @param xml Pointer to the xml structure.
+	*   @param symbols Pointer to the symbol table, NULL goes back to the tokenizer's own table.
+	*/
+	void xml_set_symbols(xml_t* xml, xml_symbols_t* symbols);
+
+	/** @brief Skip the rest of the element of the last XML_START_TAG, XML_START_ATTRIBUTES, XML_ATTRIBUTE or
+	*          XML_END_ATTRIBUTES token, the next token is the XML_END_TAG of the element. The skipped input is only
+	*          scanned for tags, quotes, comments and CDATA, no tokens or strings are made from it.
+	*   @param xml Pointer to the xml structure.
+	*   @return value > 0 if the element is skipped, 0 after other tokens or if the input ended before the end tag.
+	*          A tokenizer made with xml_create is left as it was when the end tag has not been fed yet.
+	*/
+	int xml_skip_element(xml_t* xml);
+
+	/** @brief Get the offset in bytes from the start of the input to the first byte that the tokenizer has not used
+	*          yet. After XML_START_TAG and XML_END_TAG that is the byte after the name, so '<' of a start tag is at
+	*          the offset less the length of the name and 1. A tokenizer opened with xml_open_tokens has no input
+	*          and returns 0.
+	*   @param xml Pointer to the xml structure.
+	*   @return Offset in bytes.
+	*/
+	size_t xml_get_offset(xml_t* xml);
+
+	/** @brief Only tokenize the elements and attributes at the paths, must be called before the first token. A path is
+	*          a list of element names from the root, "catalog/book/title", that can end with an attribute,
+	*          "catalog/book/@id". A name can be "*", and "//" matches any number of elements, "//price". All tokens
+	*          of a matching element are returned. The elements on the way to a match are returned with their start
+	*          and end tags and the matching attributes, their text is skipped. Other elements are skipped as with
+	*          xml_skip_element, so their text is never decoded or copied.
+	*   @param xml Pointer to the xml structure.
+	*   @param paths Array of paths, NULL removes the filter.
+	*   @param count Number of paths, at most 64 names in all.
+	*   @return value > 0 on success, 0 if a path is malformed.
+	*/
+	int xml_set_filter(xml_t* xml, const char* const* paths, size_t count);
+
 	/** @brief Return a string with an error, can only be read after a XML_ERROR token.
 	*   @param xml Pointer to the xml structure.
 	*   @return String with the error message.
@@ -123,6 +456,105 @@ extern "C" {
 	*/
 	void xml_set_collapse(xml_t* xml, int enable);
 
+	/** @brief Get lazy reference status.
+	*   @param xml Pointer to a xml structure.
+	*   @return value > 0 if enabled else it is disabled.
+	*/
+	int xml_get_lazy(xml_t* xml);
+
+	/** @brief Set lazy reference status. If set to true, entity and character references in values and texts are
+	*          kept as they are in the document, so in memory they are returned as views into the document. The views
+	*          are the raw strings, use xml_has_refs and xml_decode to decode them. xml_get_value, xml_get_text and
+	*          their lengths decode on demand. Text is collapsed before the references are decoded.
+	*   @param xml Pointer to a xml structure.
+	*   @param enable If value > 0 then lazy references are enabled else they are disabled.
+	*/
+	void xml_set_lazy(xml_t* xml, int enable);
+
+	/** @brief Tokenize a document opened with xml_open_memory or xml_open_mmap on worker threads, must be called
+	*          before the first token. The workers tokenize the elements of the document ahead in chunks, and the
+	*          tokenizer replays an element instead of reading it when it reaches the element in the same state.
+	*          The tokens are the same and in the same order as without threads. Trim and collapse are read when
+	*          the first element is looked up, elements read after they are changed are tokenized by the caller.
+	*          Only available when compiled with XML_PARALLEL.
+	*   @param xml Pointer to a xml structure.
+	*   @param count Number of worker threads.
+	*   @return value > 0 if the document is tokenized on threads.
+	*/
+	int xml_set_threads(xml_t* xml, int count);
+
+	/** @brief Read a file or reader on a thread ahead of the tokenizer, must be called before the first token. The
+	*          thread reads the next block of XML_READ_AHEAD_SIZE bytes while the tokenizer reads the current one,
+	*          so the latency of the disk or network is hidden behind the tokenizing. The reader is called from the
+	*          thread. Only available when compiled with XML_PARALLEL.
+	*   @param xml Pointer to a xml structure.
+	*   @param enable If value > 0 then the input is read ahead else it is read when it is needed.
+	*   @return value > 0 if the input is read ahead.
+	*/
+	int xml_set_read_ahead(xml_t* xml, int enable);
+
+	/** @brief Get the counters of the current document, to find out why one document is slower than another. bytes
+	*          is the input read so far, tokens counts the tokens by type (also those that a filter leaves out),
+	*          references the entity and character references that have been decoded, max_depth the deepest element,
+	*          stack_peak the most bytes on the stack and stack_grows the number of times it has been reallocated.
+	*          With XML_STATS_CYCLES cycles holds the cpu cycles spent in the tokenizer up to a token of each type.
+	*          Only available when compiled with XML_STATS.
+	*   @param xml Pointer to a xml structure.
+	*   @param stats Pointer to the counters, they are all zero without XML_STATS.
+	*   @return value > 0 if the counters are kept.
+	*/
+	int xml_get_stats(xml_t* xml, xml_stats_t* stats);
+
+	/** @brief Set up a bump allocator in a buffer, so that tokenizers can be opened and closed without calls to the
+	*          heap. Memory is only given back when the last allocation is freed or the arena is reset, when the
+	*          buffer is full the arena falls back to XML_REALLOC and XML_FREE.
+	*   @param arena Pointer to the arena.
+	*   @param buffer Memory for the arena, it must be valid as long as the arena is used.
+	*   @param size Size of the buffer in bytes.
+	*/
+	void xml_arena_init(xml_arena_t* arena, void* buffer, size_t size);
+
+	/** @brief Return an allocator that allocates from the arena, for xml_fopen_ex and friends.
+	*   @param arena Pointer to the arena.
+	*   @return The allocator.
+	*/
+	xml_allocator_t xml_arena_allocator(xml_arena_t* arena);
+
+	/** @brief Release all memory of the arena, the tokenizers that used it must be closed.
+	*   @param arena Pointer to the arena.
+	*/
+	void xml_arena_reset(xml_arena_t* arena);
+
+	/** @brief Create a symbol table that can be shared by tokenizers, see xml_set_symbols.
+	*   @return Pointer to the symbol table.
+	*/
+	xml_symbols_t* xml_symbols_create(void);
+
+	/** @brief Create a symbol table, all memory of the table is allocated with the allocator.
+	*   @param allocator Pointer to the allocator, the structure is copied.
+	*   @return Pointer to the symbol table.
+	*/
+	xml_symbols_t* xml_symbols_create_ex(const xml_allocator_t* allocator);
+
+	/** @brief Add a name to the symbol table, ids are given out in order from 1.
+	*   @param symbols Pointer to the symbol table.
+	*   @param name The name.
+	*   @return Symbol id of the name, the id it already has if it was added before.
+	*/
+	int xml_symbols_add(xml_symbols_t* symbols, const char* name);
+
+	/** @brief Return the name of a symbol id, the string is valid until the next name is added.
+	*   @param symbols Pointer to the symbol table.
+	*   @param id Symbol id.
+	*   @return The name, NULL if the id is not in the table.
+	*/
+	const char* xml_symbols_get_name(const xml_symbols_t* symbols, int id);
+
+	/** @brief Free the symbol table, it must not be used by any tokenizer.
+	*   @param symbols Pointer to the symbol table.
+	*/
+	void xml_symbols_free(xml_symbols_t* symbols);
+
 	/** @brief Close the xml file and free memory for the xml structure
 	*   @param xml Pointer to the xml structure.
 	*/
@@ -139,61 +571,182 @@ extern "C" {
 #define XML_FREE(c,p)      free(p)
 #endif
 
-#if defined(XML_FOPEN) && !defined(XML_FGETC) || defined(XML_FOPEN) && !defined(XML_FCLOSE)
-#error "You must define both XML_FOPEN, XML_FGETC and XML_FCLOSE, or neither."
+#if defined(XML_FOPEN) && !defined(XML_FREAD) || defined(XML_FOPEN) && !defined(XML_FCLOSE)
+#error "You must define both XML_FOPEN, XML_FREAD and XML_FCLOSE, or neither."
 #endif
 
-#if defined(XML_FGETC) && !defined(XML_FOPEN) || defined(XML_FGETC) && !defined(XML_FCLOSE)
-#error "You must define both XML_FOPEN, XML_FGETC and XML_FCLOSE, or neither."
+#if defined(XML_FREAD) && !defined(XML_FOPEN) || defined(XML_FREAD) && !defined(XML_FCLOSE)
+#error "You must define both XML_FOPEN, XML_FREAD and XML_FCLOSE, or neither."
 #endif
 
-#if defined(XML_FCLOSE) && !defined(XML_FOPEN) || defined(XML_FCLOSE) && !defined(XML_FGETC)
-#error "You must define both XML_FOPEN, XML_FGETC and XML_FCLOSE, or neither."
+#if defined(XML_FCLOSE) && !defined(XML_FOPEN) || defined(XML_FCLOSE) && !defined(XML_FREAD)
+#error "You must define both XML_FOPEN, XML_FREAD and XML_FCLOSE, or neither."
 #endif
 
-#if !defined(XML_FOPEN) && !defined(XML_FGETC) && !defined(XML_FCLOSE)
+#if !defined(XML_FOPEN) && !defined(XML_FREAD) && !defined(XML_FCLOSE)
+#include <stdio.h>
 #ifdef _MSC_VER
 #define XML_FOPEN(fp,filename,mode) fopen_s(&(fp),filename,mode)
 #else
 #define XML_FOPEN(fp,filename,mode) (((fp=fopen(filename,mode))==NULL)?(-1):(-(feof(fp)||ferror(fp))))
 #endif
-#define XML_FGETC(fp) fgetc(fp)
+#define XML_FREAD(fp,buffer,size,length) (((length)=fread(buffer,1,size,fp)),ferror(fp))
 #define XML_FCLOSE(fp) fclose(fp)
 #endif
 
+#ifdef XML_GZIP
+#include <zlib.h>
+#endif
+#ifdef XML_ZSTD
+#include <zstd.h>
+#endif
+
+#ifndef XML_BUFFER_SIZE
+#define XML_BUFFER_SIZE (65536)
+#endif
+
+#include <string.h>
+
+#if !defined(XML_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__)))
+#define XML__X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define XML__TARGET_AVX2
+#else
+#define XML__TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifndef XML_NO_MMAP
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+#ifdef XML_PARALLEL
+#ifndef XML_PARALLEL_CHUNK_SIZE
+#define XML_PARALLEL_CHUNK_SIZE (4194304)
+#endif
+#ifndef XML_READ_AHEAD_SIZE
+#define XML_READ_AHEAD_SIZE (1048576)
+#endif
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE xml__thread_t;
+typedef DWORD xml__thread_result_t;
+typedef CRITICAL_SECTION xml__mutex_t;
+typedef CONDITION_VARIABLE xml__cond_t;
+#define XML__THREAD_CALL WINAPI
+#define xml__thread_create(t,f,a) (*(t)=CreateThread(NULL,0,f,a,0,NULL))
+#define xml__thread_join(t) (WaitForSingleObject(t,INFINITE),CloseHandle(t))
+#define xml__mutex_init(m) InitializeCriticalSection(m)
+#define xml__mutex_destroy(m) DeleteCriticalSection(m)
+#define xml__mutex_lock(m) EnterCriticalSection(m)
+#define xml__mutex_unlock(m) LeaveCriticalSection(m)
+#define xml__cond_init(c) InitializeConditionVariable(c)
+#define xml__cond_destroy(c) ((void)(c))
+#define xml__cond_wait(c,m) SleepConditionVariableCS(c,m,INFINITE)
+#define xml__cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_t xml__thread_t;
+typedef void* xml__thread_result_t;
+typedef pthread_mutex_t xml__mutex_t;
+typedef pthread_cond_t xml__cond_t;
+#define XML__THREAD_CALL
+#define xml__thread_create(t,f,a) pthread_create(t,NULL,f,a)
+#define xml__thread_join(t) pthread_join(t,NULL)
+#define xml__mutex_init(m) pthread_mutex_init(m,NULL)
+#define xml__mutex_destroy(m) pthread_mutex_destroy(m)
+#define xml__mutex_lock(m) pthread_mutex_lock(m)
+#define xml__mutex_unlock(m) pthread_mutex_unlock(m)
+#define xml__cond_init(c) pthread_cond_init(c,NULL)
+#define xml__cond_destroy(c) pthread_cond_destroy(c)
+#define xml__cond_wait(c,m) pthread_cond_wait(c,m)
+#define xml__cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+#endif
+
+#if defined(XML_STATS_CYCLES) && !defined(XML_STATS)
+#define XML_STATS
+#endif
+#ifdef XML_STATS_CYCLES
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define xml__cycles() ((uint64_t)__rdtsc())
+#endif
+#endif
+#if defined(XML_STATS) && !defined(xml__cycles)
+#define xml__cycles() ((uint64_t)0)
+#endif
+
+#ifdef XML_STATS
+#define XML__STAT(x) do{x;}while(0)
+#else
+#define XML__STAT(x) ((void)0)
+#endif
+
+/* The case labels of the coroutine are entered from the code above them on purpose. */
+#if defined(__cplusplus) && __cplusplus >= 201703L
+#define XML__FALLTHROUGH [[fallthrough]]
+#elif defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define XML__FALLTHROUGH __attribute__((fallthrough))
+#endif
+#endif
+#ifndef XML__FALLTHROUGH
+#define XML__FALLTHROUGH ((void)0)
+#endif
+
 #define STACK_SIZE (4096)
 #define XML_SPACE_STACK_SIZE (32)
-#define LABEL(addr) do{case addr:;}while(0);
+#define LABEL(addr) do{XML__FALLTHROUGH;case addr:;}while(0);
 #define JMP(addr) do{xml->lc=addr;goto jp;}while(0)
 #define CALL(ret_addr,call_addr) do{{enum xml__label ret=ret_addr; xml->lc=call_addr;xml__push(xml,&ret,sizeof(enum xml__label));}goto jp;case ret_addr:;}while(0)
 #define RET() do{xml->lc=*(enum xml__label*)xml__pop(xml, sizeof(enum xml__label));goto jp;}while(0);
-#define TOK(addr,tok) do{xml->lc=addr;return tok;case addr:;}while(0)
+#define TOK(addr,tok) do{xml->lc=addr;XML__STAT(xml__stat_token(xml,tok));if((xml->batch==NULL&&xml->filter==NULL)||xml__emit(xml,tok))return tok;if(xml->lc!=addr)goto jp;XML__FALLTHROUGH;case addr:;}while(0)
 #define NEXTCH() do{if(!xml__nextch(xml)) JMP(xml__error_loop);}while(0)
 #define FLAG_TRIM (0)
 #define FLAG_COLLAPSE (1)
 #define FLAG_PRESERVE (2)
+#define FLAG_LAZY (3)
+#define FLAG_DISCARD (4)
+#define POSTFIX_REFS (0x80)
 #define RET_COMMENT_OR_DOCTYPE (0)
 #define RET_TAG_END (1)
 #define RET_CDATA (2)
 
 	enum xml__label {
 		xml__start,
+		xml__subtree,
 		xml__padding,
 		xml__name,
 		xml__value,
 		xml__attr,
-		xml__tag, xml__tag_loop, xml__tag_loop_no_trim,
+		xml__tag, xml__tag_loop, xml__tag_loop_no_trim, xml__skip_end,
 		xml__escape_sign,
 		xml__error, xml__error_loop,
 		xml__c1, xml__c2, xml__c3, xml__c4, xml__c5, xml__c6, xml__c7, xml__c8, xml__c9, xml__c10,
 		xml__c11, xml__c12, xml__c13, xml__c14, xml__c15, xml__c16, xml__c17, xml__c18, xml__c19,
-		xml__c20, xml__c21, xml__c22, xml__c23, xml__c24,
+		xml__c20, xml__c21, xml__c22, xml__c23, xml__c24, xml__c25,
 		xml__l1, xml__l2, xml__l3, xml__l4,
-		xml__t1, xml__t2, xml__t3, xml__t4, xml__t5, xml__t6, xml__t7, xml__t8, xml__t9, xml__t10, xml__t11
+		xml__tokens,
+		xml__t1, xml__t2, xml__t3, xml__t4, xml__t5, xml__t6, xml__t7, xml__t8, xml__t9, xml__t10, xml__t11, xml__t12, xml__t13,
+		xml__t14
 	};
 
 	const char xml__error_unexpected_end_of_file[] = "Error: Unexpected end of file.";
-	const char xml__error_while_reading_file[] = "Error: While reading file, code: ";
+	const char xml__error_while_reading_file[] = "Error: While reading file.";
 	const char xml__error_prefix[] = "Error(";
 	const char xml__unexpected_sign[] = "): Unexpected sign.";
 
@@ -201,35 +754,212 @@ extern "C" {
 		int level, preserve;
 	};
 
+	/* Kernels used by the hot loops, selected per parser from the features of the cpu. */
+	struct xml__kernels {
+		const uint8_t* (*scan_text)(const uint8_t* p, const uint8_t* end, int collapse, int prev);
+		const uint8_t* (*skip_ws)(const uint8_t* p, const uint8_t* end, int ff);
+		const uint8_t* (*trim_ws)(const uint8_t* begin, const uint8_t* end);
+	};
+
+	/* What the tokenizer changes while it runs, saved at every token in push mode so that a token that runs out of
+	*  input can be tokenized again from its start when more is fed.
+	*/
+	struct xml__state {
+		enum xml__label lc;
+		size_t in_pos, filter_depth;
+		int ch, ra, rb, rc, row, col, sc, level, flags, refs, xml_space_count;
+#ifdef XML_STATS
+		uint64_t references;
+#endif
+	};
+
 	struct xml__impl {
-		FILE* fp;
+		xml_allocator_t allocator;
+		xml_reader_t reader;
+		size_t in_base, in_pos, in_len, in_capacity;
+		uint8_t* in;
+		uint8_t* buffer;
+		const uint8_t* span;
+		const uint8_t* span_end;
 		enum xml__label lc;
-		int ch, ra, rb, rc, row, col, sc, level, flags, xml_space_count;
+		int ch, ra, rb, rc, row, col, sc, level, flags, refs, xml_space_count, resident;
+		const struct xml__kernels* kernels;
+		struct xml__parallel* parallel;
+		struct xml__ahead* ahead;
+		const uint8_t* replay;
+		const uint8_t* replay_end;
+		const uint8_t* tokens_offsets;
+		const uint8_t* tokens_strings;
+		uint64_t tokens_string_count, tokens_strings_size;
+		size_t replay_exit;
+		int replay_sc, replay_token;
+		xml_token_rec_t* batch;
+		size_t batch_count, batch_max, strings_len, strings_capacity;
+		uint8_t* strings;
+		xml_symbols_t* symbols;
+		xml_symbols_t* own_symbols;
+		struct xml__filter* filter;
+		int push, push_final, starved, save_floor;
+		struct xml__state saved;
+		size_t buffer_capacity, save_capacity;
+		uint8_t* save_stack;
 		struct xml__xml_space xml_space_stack[XML_SPACE_STACK_SIZE];
 		size_t stack_capacity;
 		uint8_t* stack;
+		size_t cstr_capacity[2];
+		char* cstr[2];
+#ifdef XML_STATS
+		xml_stats_t stats;
+		int stats_depth;
+		uint64_t stats_stamp;
+#endif
 	};
 
-	static void xml__push(xml_t* xml, const void* data, size_t size)
+	enum { XML__FILTER_SKIP, XML__FILTER_PASS, XML__FILTER_MATCH };
+
+	struct xml__filter_step {
+		const char* name;
+		size_t len;
+		int attribute, descendant, last;
+	};
+
+	/* The steps that the children of an element can match, and the attribute steps of the element itself. */
+	struct xml__filter_frame {
+		uint64_t active, attributes;
+		int kind;
+	};
+
+	struct xml__filter {
+		struct xml__filter_step steps[64];
+		size_t step_count, frame_count, frame_capacity;
+		uint64_t start;
+		char* names;
+		struct xml__filter_frame* frames;
+	};
+
+	static void* xml__alloc(const xml_allocator_t* allocator, void* ptr, size_t size)
+	{
+		if (allocator->reallocate != NULL) return allocator->reallocate(allocator->context, ptr, size);
+		return XML_REALLOC(allocator->context, ptr, size);
+	}
+
+	static void xml__dealloc(const xml_allocator_t* allocator, void* ptr)
+	{
+		if (allocator->deallocate != NULL) allocator->deallocate(allocator->context, ptr);
+		else XML_FREE(allocator->context, ptr);
+	}
+
+	/* Grow the stack so size more bytes fit, pointers into the stack are not valid after it. */
+	static void xml__reserve(xml_t* xml, size_t size)
 	{
 		if ((xml->sc + size) > xml->stack_capacity) {
 			size_t new_capacity = xml->stack_capacity * 2;
-			uint8_t* new_stack = (uint8_t*)XML_REALLOC(NULL, xml->stack, new_capacity);
+			while ((xml->sc + size) > new_capacity) new_capacity *= 2;
+			uint8_t* new_stack = (uint8_t*)xml__alloc(&xml->allocator, xml->stack, new_capacity);
 			if (new_stack == NULL) {
 				fprintf(stderr, "PANIC failed to allocate memory for xml_t stack!");
 				exit(-1);
 			}
 			xml->stack = new_stack;
 			xml->stack_capacity = new_capacity;
+			XML__STAT(xml->stats.stack_grows++);
+		}
+		XML__STAT(if ((size_t)xml->sc + size > xml->stats.stack_peak) xml->stats.stack_peak = (size_t)xml->sc + size);
+	}
+
+	static void xml__push(xml_t* xml, const void* data, size_t size)
+	{
+		xml__reserve(xml, size);
+		if (size > 16) {
+			memcpy(&xml->stack[xml->sc], data, size);
+			xml->sc += (int)size;
+			return;
 		}
 		for (size_t i = 0; i < size; i++) {
 			xml->stack[xml->sc++] = ((uint8_t*)data)[i];
 		}
 	}
 
+#ifdef XML_STATS
+	/* Count a token, and charge the cycles since the last token or since xml_next_token was called to its type. */
+	static void xml__stat_token(xml_t* xml, xml_token_t token)
+	{
+		uint64_t now = xml__cycles();
+		xml->stats.cycles[token] += now - xml->stats_stamp;
+		xml->stats_stamp = now;
+		xml->stats.tokens[token]++;
+		if (token == XML_START_TAG && ++xml->stats_depth > xml->stats.max_depth) xml->stats.max_depth = xml->stats_depth;
+		else if (token == XML_END_TAG) xml->stats_depth--;
+	}
+#endif
+
+	/* Save the state at a token in push mode. The stack is not copied, the bytes below the saved top are kept by
+	*  xml__keep_stack when they are popped, as only then can they be written over.
+	*/
+	static void xml__save(xml_t* xml)
+	{
+		struct xml__state* saved = &xml->saved;
+		saved->lc = xml->lc;
+		saved->in_pos = xml->in_pos;
+		saved->filter_depth = xml->filter != NULL ? xml->filter->frame_count : 0;
+		saved->ch = xml->ch;
+		saved->ra = xml->ra;
+		saved->rb = xml->rb;
+		saved->rc = xml->rc;
+		saved->row = xml->row;
+		saved->col = xml->col;
+		saved->sc = xml->sc;
+		saved->level = xml->level;
+		saved->flags = xml->flags;
+		saved->refs = xml->refs;
+		saved->xml_space_count = xml->xml_space_count;
+		XML__STAT(saved->references = xml->stats.references);
+		xml->save_floor = xml->sc;
+	}
+
+	static void xml__keep_stack(xml_t* xml)
+	{
+		if (xml->save_capacity < (size_t)xml->saved.sc) {
+			uint8_t* save_stack = (uint8_t*)xml__alloc(&xml->allocator, xml->save_stack, xml->stack_capacity);
+			if (save_stack == NULL) {
+				fprintf(stderr, "PANIC failed to allocate memory for xml_t stack!");
+				exit(-1);
+			}
+			xml->save_stack = save_stack;
+			xml->save_capacity = xml->stack_capacity;
+		}
+		memcpy(&xml->save_stack[xml->sc], &xml->stack[xml->sc], (size_t)(xml->save_floor - xml->sc));
+		xml->save_floor = xml->sc;
+	}
+
+	/* Go back to the saved state when the input that has been fed runs out in the middle of a token. */
+	static void xml__restore(xml_t* xml)
+	{
+		struct xml__state* saved = &xml->saved;
+		if (xml->save_floor < saved->sc) memcpy(&xml->stack[xml->save_floor], &xml->save_stack[xml->save_floor], (size_t)(saved->sc - xml->save_floor));
+		xml->lc = saved->lc;
+		xml->in_pos = saved->in_pos;
+		if (xml->filter != NULL) xml->filter->frame_count = saved->filter_depth;
+		xml->ch = saved->ch;
+		xml->ra = saved->ra;
+		xml->rb = saved->rb;
+		xml->rc = saved->rc;
+		xml->row = saved->row;
+		xml->col = saved->col;
+		xml->sc = saved->sc;
+		xml->level = saved->level;
+		xml->flags = saved->flags;
+		xml->refs = saved->refs;
+		xml->xml_space_count = saved->xml_space_count;
+		XML__STAT(xml->stats.references = saved->references);
+		xml->save_floor = xml->sc;
+		xml->starved = 0;
+	}
+
 	static const void* xml__pop(xml_t* xml, size_t size)
 	{
 		xml->sc -= (int)size;
+		if (xml->sc < xml->save_floor) xml__keep_stack(xml);
 		return &(xml->stack[xml->sc]);
 	}
 
@@ -238,17 +968,62 @@ extern "C" {
 		return &(xml->stack[xml->sc - size - index]);
 	}
 
-	static const char* xml__peek_str(xml_t* xml)
+	/* Strings on the stack are stored as [chars][nul][int len][postfix] where len includes the nul,
+	*  or, when they are a view into a resident document, as [ptr][int len][POSTFIX] with an upper case postfix.
+	*  POSTFIX_REFS is set in the postfix of a value or text that still contains references, in lazy mode.
+	*/
+	static size_t xml__peek_view(xml_t* xml, size_t top, xml_strview_t* view)
+	{
+		uint8_t postfix = xml->stack[top - sizeof(uint8_t)] & ~POSTFIX_REFS;
+		int len = *((int*)&xml->stack[top - sizeof(uint8_t) - sizeof(int)]);
+		if (postfix >= 'A' && postfix <= 'Z') {
+			view->ptr = *((const char**)&xml->stack[top - sizeof(uint8_t) - sizeof(int) - sizeof(const char*)]);
+			view->len = (size_t)len;
+			return sizeof(const char*) + sizeof(int) + sizeof(uint8_t);
+		}
+		view->ptr = (const char*)&xml->stack[top - sizeof(uint8_t) - sizeof(int) - len];
+		view->len = (size_t)len - 1;
+		return len + sizeof(int) + sizeof(uint8_t);
+	}
+
+	static xml_strview_t xml__pop_str(xml_t* xml) {
+		xml_strview_t view;
+		xml->sc -= (int)xml__peek_view(xml, xml->sc, &view);
+		if (xml->sc < xml->save_floor) xml__keep_stack(xml);
+		return view;
+	}
+
+	static void xml__push_ref(xml_t* xml, const uint8_t* ptr, int len, uint8_t postfix)
+	{
+		uint8_t ref[sizeof(const uint8_t*) + sizeof(int) + sizeof(uint8_t)];
+		memcpy(ref, &ptr, sizeof(const uint8_t*));
+		memcpy(ref + sizeof(const uint8_t*), &len, sizeof(int));
+		ref[sizeof(ref) - 1] = postfix;
+		xml__push(xml, ref, sizeof(ref));
+	}
+
+	/* Move the string on top of the stack below the return address that is stored under it. */
+	static void xml__rotate_label(xml_t* xml)
+	{
+		xml_strview_t view;
+		size_t size = xml__peek_view(xml, xml->sc, &view);
+		enum xml__label lc = *((enum xml__label*)&xml->stack[xml->sc - size - sizeof(enum xml__label)]);
+		memmove(&xml->stack[xml->sc - size - sizeof(enum xml__label)], &xml->stack[xml->sc - size], size);
+		*((enum xml__label*)&xml->stack[xml->sc - sizeof(enum xml__label)]) = lc;
+	}
+
+	/* Copy the pending span of a resident document onto the stack, from here on the string is built on the stack. */
+	static void xml__flush_span(xml_t* xml, const uint8_t* end)
 	{
-		int size = *((uint32_t*)&xml->stack[xml->sc - sizeof(int)]);
-		return (const char*)(xml->stack + xml->sc - sizeof(uint32_t) - size - 1);
+		if (xml->span != NULL) {
+			xml__push(xml, xml->span, end - xml->span);
+			xml->span = NULL;
+		}
 	}
 
-	static const char* xml__pop_str(xml_t* xml) {
-		int size = *((int*)&xml->stack[xml->sc - sizeof(int) - sizeof(uint8_t)]);
-		const char* str = (const char*)(xml->stack + xml->sc - sizeof(int) - size - sizeof(uint8_t));
-		xml->sc -= (sizeof(int) + size + sizeof(uint8_t));
-		return str;
+	static int xml__view_prefix(xml_strview_t view, const char* str, size_t n)
+	{
+		return view.ptr != NULL && view.len >= n && memcmp(view.ptr, str, n) == 0;
 	}
 
 	static size_t xml__strlen(const char* str) {
@@ -257,14 +1032,6 @@ extern "C" {
 		return n - str;
 	}
 
-	static void xml__push_str(xml_t* xml, const char* str, uint8_t postfix) {
-
-		int  len = (int)(xml__strlen(str) + sizeof(uint8_t));
-		xml__push(xml, str, len);
-		xml__push(xml, &len, sizeof(int));
-		xml__push(xml, &postfix, sizeof(uint8_t));
-	}
-
 	static int xml__strncmp(const char* a, const char* b, size_t n)
 	{
 		while (n && *a && (*a == *b)) {
@@ -286,12 +1053,6 @@ extern "C" {
 		return &buf[i + 1];
 	}
 
-	static char xml__toupper(char c)
-	{
-		if (c >= 'a' && c <= 'z') return 'A' - 'a' + c;
-		return c;
-	}
-
 	static void xml__restore_xml_space_stack(xml_t* xml)
 	{
 		if (xml->xml_space_count > 0) {
@@ -309,40 +1070,350 @@ extern "C" {
 		xml->level--;
 	}
 
-	static int xml__nextch(xml_t* xml)
-	{
-		int c = XML_FGETC(xml->fp);
+	static int xml__ahead_read(xml_t* xml, size_t* length);
 
-		if (c == EOF) {
-			uint8_t postfix = 'e';
-			if (feof(xml->fp)) {
-				xml__push(xml, xml__error_unexpected_end_of_file, sizeof(xml__error_unexpected_end_of_file));
-				int len = (int)sizeof(xml__error_unexpected_end_of_file);
-				xml__push(xml, &len, sizeof(int));
-				xml__push(xml, &postfix, sizeof(uint8_t));
-			}
-			else {
-				size_t sc = xml->sc;
-				xml__push(xml, xml__error_while_reading_file, sizeof(xml__error_while_reading_file));
-				int len = (int)sizeof(xml__error_while_reading_file);
-				xml__push(xml, &len, sizeof(int));
-				xml__push(xml, &postfix, sizeof(uint8_t));
-			}
+	static int xml__fill(xml_t* xml)
+	{
+		size_t length = 0;
+		int code = 0;
+		if (xml->ahead != NULL) code = xml__ahead_read(xml, &length);
+		else if (xml->reader.read != NULL) code = xml->reader.read(xml->reader.context, xml->in, xml->in_capacity, &length);
+		else if (xml->push && !xml->push_final) {
+			// Everything that has been fed is read, the token is tokenized again when more is fed
+			xml->starved = 1;
 			return 0;
 		}
+
+		if (code != 0 || length == 0) {
+			// The code of a reader is only non-zero on an error, it is no error number
+			uint8_t postfix = 'e';
+			const char* error = code == 0 ? xml__error_unexpected_end_of_file : xml__error_while_reading_file;
+			int len = code == 0 ? (int)sizeof(xml__error_unexpected_end_of_file) : (int)sizeof(xml__error_while_reading_file);
+			xml__push(xml, error, len);
+			xml__push(xml, &len, sizeof(int));
+			xml__push(xml, &postfix, sizeof(uint8_t));
+			return 0;
+		}
+		xml->in_base += xml->in_len;
+		xml->in_pos = 0;
+		xml->in_len = length;
+		return 1;
+	}
+
+	static int xml__nextch(xml_t* xml)
+	{
+		if (xml->in_pos == xml->in_len && !xml__fill(xml)) return 0;
+
+		int c = xml->in[xml->in_pos++];
+		if (c == '\n') {
+			xml->row++;
+			xml->col = 1;
+		}
 		else {
-			if (c == '\n') {
-				xml->row++;
-				xml->col = 1;
-			}
-			else {
-				xml->col++;
-			}
+			xml->col++;
 		}
 		xml->ch = c;
 		return 1;
 	}
 
+	static void xml__advance(xml_t* xml, const uint8_t* p, const uint8_t* end)
+	{
+		const uint8_t* nl;
+		while ((nl = (const uint8_t*)memchr(p, '\n', end - p)) != NULL) {
+			xml->row++;
+			xml->col = 1;
+			p = nl + 1;
+		}
+		xml->col += (int)(end - p);
+	}
+
+	/* Text kernels: return the first byte in [p, end) that the text loop must handle itself, that is '<' and '&',
+	*  and when collapsing also line-feed, carriage-return, tab and a space that follows a space. 'prev' is the
+	*  character before p.
+	*/
+	static const uint8_t* xml__scan_text_scalar(const uint8_t* p, const uint8_t* end, int collapse, int prev)
+	{
+		for (; p < end; prev = *p++) {
+			uint8_t c = *p;
+			if (c == '<' || c == '&') break;
+			if (collapse && (c == '\n' || c == '\r' || c == '\t' || (c == ' ' && prev == ' '))) break;
+		}
+		return p;
+	}
+
+	/* White-space kernels: skip_ws returns the first byte in [p, end) that is not a space, line-feed, carriage-return
+	*  or tab, or form-feed when 'ff' is set. trim_ws returns the end of [begin, end) without trailing white-space,
+	*  form-feed included.
+	*/
+	static const uint8_t* xml__skip_ws_scalar(const uint8_t* p, const uint8_t* end, int ff)
+	{
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t' || (ff && *p == '\f'))) p++;
+		return p;
+	}
+
+	static const uint8_t* xml__trim_ws_scalar(const uint8_t* begin, const uint8_t* end)
+	{
+		while (end > begin && (end[-1] == ' ' || end[-1] == '\n' || end[-1] == '\r' || end[-1] == '\f' || end[-1] == '\t')) end--;
+		return end;
+	}
+
+	static int xml__isname(uint8_t ch)
+	{
+		return ch > 127 || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+			ch == '_' || ch == ':' || ch == '-' || ch == '.';
+	}
+
+	static const struct xml__kernels xml__kernels_scalar = { xml__scan_text_scalar, xml__skip_ws_scalar, xml__trim_ws_scalar };
+
+#ifdef XML__X86
+	static int xml__ctz(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	static int xml__msb(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, mask);
+		return (int)index;
+#else
+		return 31 - __builtin_clz(mask);
+#endif
+	}
+
+	static const uint8_t* xml__scan_text_sse2(const uint8_t* p, const uint8_t* end, int collapse, int prev)
+	{
+		const __m128i lt = _mm_set1_epi8('<'), amp = _mm_set1_epi8('&'), space = _mm_set1_epi8(' ');
+		const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r'), tab = _mm_set1_epi8('\t');
+		const uint8_t* begin = p;
+		uint32_t carry = prev == ' ';
+		while (end - p >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)p);
+			uint32_t stop = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)));
+			if (collapse) {
+				uint32_t spaces = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, space));
+				__m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)), _mm_cmpeq_epi8(v, tab));
+				stop |= (uint32_t)_mm_movemask_epi8(ws) | (spaces & ((spaces << 1) | carry));
+				carry = spaces >> 15;
+			}
+			if (stop) return p + xml__ctz(stop);
+			p += 16;
+		}
+		return xml__scan_text_scalar(p, end, collapse, p > begin ? p[-1] : prev);
+	}
+
+	static __m128i xml__ws_sse2(__m128i v, int ff)
+	{
+		__m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		ws = _mm_or_si128(ws, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+		if (ff) ws = _mm_or_si128(ws, _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')));
+		return ws;
+	}
+
+	static const uint8_t* xml__skip_ws_sse2(const uint8_t* p, const uint8_t* end, int ff)
+	{
+		while (end - p >= 16) {
+			uint32_t other = ~(uint32_t)_mm_movemask_epi8(xml__ws_sse2(_mm_loadu_si128((const __m128i*)p), ff)) & 0xFFFF;
+			if (other) return p + xml__ctz(other);
+			p += 16;
+		}
+		return xml__skip_ws_scalar(p, end, ff);
+	}
+
+	static const uint8_t* xml__trim_ws_sse2(const uint8_t* begin, const uint8_t* end)
+	{
+		while (end - begin >= 16) {
+			uint32_t other = ~(uint32_t)_mm_movemask_epi8(xml__ws_sse2(_mm_loadu_si128((const __m128i*)(end - 16)), 1)) & 0xFFFF;
+			if (other) return end - 16 + xml__msb(other) + 1;
+			end -= 16;
+		}
+		return xml__trim_ws_scalar(begin, end);
+	}
+
+	XML__TARGET_AVX2 static const uint8_t* xml__scan_text_avx2(const uint8_t* p, const uint8_t* end, int collapse, int prev)
+	{
+		const __m256i lt = _mm256_set1_epi8('<'), amp = _mm256_set1_epi8('&'), space = _mm256_set1_epi8(' ');
+		const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r'), tab = _mm256_set1_epi8('\t');
+		const uint8_t* begin = p;
+		uint32_t carry = prev == ' ';
+		while (end - p >= 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)p);
+			uint32_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, lt), _mm256_cmpeq_epi8(v, amp)));
+			if (collapse) {
+				uint32_t spaces = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, space));
+				__m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)), _mm256_cmpeq_epi8(v, tab));
+				stop |= (uint32_t)_mm256_movemask_epi8(ws) | (spaces & ((spaces << 1) | carry));
+				carry = spaces >> 31;
+			}
+			if (stop) return p + xml__ctz(stop);
+			p += 32;
+		}
+		return xml__scan_text_sse2(p, end, collapse, p > begin ? p[-1] : prev);
+	}
+
+	XML__TARGET_AVX2 static __m256i xml__ws_avx2(__m256i v, int ff)
+	{
+		__m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		ws = _mm256_or_si256(ws, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+		if (ff) ws = _mm256_or_si256(ws, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')));
+		return ws;
+	}
+
+	XML__TARGET_AVX2 static const uint8_t* xml__skip_ws_avx2(const uint8_t* p, const uint8_t* end, int ff)
+	{
+		while (end - p >= 32) {
+			uint32_t other = ~(uint32_t)_mm256_movemask_epi8(xml__ws_avx2(_mm256_loadu_si256((const __m256i*)p), ff));
+			if (other) return p + xml__ctz(other);
+			p += 32;
+		}
+		return xml__skip_ws_sse2(p, end, ff);
+	}
+
+	XML__TARGET_AVX2 static const uint8_t* xml__trim_ws_avx2(const uint8_t* begin, const uint8_t* end)
+	{
+		while (end - begin >= 32) {
+			uint32_t other = ~(uint32_t)_mm256_movemask_epi8(xml__ws_avx2(_mm256_loadu_si256((const __m256i*)(end - 32)), 1));
+			if (other) return end - 32 + xml__msb(other) + 1;
+			end -= 32;
+		}
+		return xml__trim_ws_sse2(begin, end);
+	}
+
+	static const struct xml__kernels xml__kernels_sse2 = { xml__scan_text_sse2, xml__skip_ws_sse2, xml__trim_ws_sse2 };
+	static const struct xml__kernels xml__kernels_avx2 = { xml__scan_text_avx2, xml__skip_ws_avx2, xml__trim_ws_avx2 };
+
+	static int xml__has_avx2(void)
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return 0;
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) return 0;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	static int xml__ctz64(uint64_t mask)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, mask);
+		return (int)index;
+#elif defined(_MSC_VER)
+		int n = 0;
+		while ((mask & 1) == 0) { mask >>= 1; n++; }
+		return n;
+#else
+		return __builtin_ctzll(mask);
+#endif
+	}
+
+	static const uint8_t* xml__scan_text(xml_t* xml, const uint8_t* p, const uint8_t* end, int collapse, int prev)
+	{
+		return xml->kernels->scan_text(p, end, collapse, prev);
+	}
+
+	static const uint8_t* xml__skip_ws(xml_t* xml, const uint8_t* p, const uint8_t* end, int ff)
+	{
+		return xml->kernels->skip_ws(p, end, ff);
+	}
+
+	static const uint8_t* xml__scan_name(const uint8_t* p, const uint8_t* end)
+	{
+		while (p < end && xml__isname(*p)) p++;
+		return p;
+	}
+
+	static const uint8_t* xml__scan_value(const uint8_t* p, const uint8_t* end, int quote)
+	{
+		while (p < end && *p != quote && *p != '&') p++;
+		return p;
+	}
+
+	/* Value of a decimal or hexadecimal digit, 255 for other characters. */
+	static const uint8_t xml__digits[256] = {
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 255, 255, 255, 255, 255, 255,
+		255, 10, 11, 12, 13, 14, 15, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 10, 11, 12, 13, 14, 15, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+	};
+
+	/* The predefined entities of xml. */
+	static const struct { const char* name; size_t len; uint8_t ch; } xml__entities[] = {
+		{ "amp", 3, '&' }, { "lt", 2, '<' }, { "gt", 2, '>' }, { "quot", 4, '\"' }, { "apos", 4, '\'' }
+	};
+
+	/* Decode the reference between '&' and ';' to utf-8, returns the number of bytes in utf8 or 0 if it is not valid.
+	*  The bytes are only written when the whole reference is read, so the reference can be decoded in place.
+	*/
+	static int xml__decode_ref(const uint8_t* ref, size_t len, uint8_t* utf8)
+	{
+		if (len > 1 && ref[0] == '#') {
+			uint32_t base = ref[1] == 'x' ? 16 : 10, cp = 0;
+			size_t i = base == 16 ? 2 : 1;
+			if (i == len) return 0;
+			for (; i < len; i++) {
+				uint8_t digit = xml__digits[ref[i]];
+				if (digit >= base) return 0;
+				cp = cp * base + digit;
+				if (cp > 0x10FFFF) return 0;
+			}
+			if (cp == 0 || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+			if (cp < 0x80) {
+				utf8[0] = (uint8_t)cp;
+				return 1;
+			}
+			if (cp < 0x800) {
+				utf8[0] = (uint8_t)(0xC0 | (cp >> 6));
+				utf8[1] = (uint8_t)(0x80 | (cp & 0x3F));
+				return 2;
+			}
+			if (cp < 0x10000) {
+				utf8[0] = (uint8_t)(0xE0 | (cp >> 12));
+				utf8[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+				utf8[2] = (uint8_t)(0x80 | (cp & 0x3F));
+				return 3;
+			}
+			utf8[0] = (uint8_t)(0xF0 | (cp >> 18));
+			utf8[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+			utf8[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+			utf8[3] = (uint8_t)(0x80 | (cp & 0x3F));
+			return 4;
+		}
+		for (size_t i = 0; i < sizeof(xml__entities) / sizeof(xml__entities[0]); i++) {
+			if (len == xml__entities[i].len && memcmp(ref, xml__entities[i].name, len) == 0) {
+				utf8[0] = xml__entities[i].ch;
+				return 1;
+			}
+		}
+		return 0;
+	}
+
 	static int xml__isalnum(char ch)
 	{
 		if (ch >= 'a' && ch <= 'z') return 1;
@@ -351,102 +1422,611 @@ extern "C" {
 		else return 0;
 	}
 
-	xml_t* xml_fopen(const char* filename)
+	static int xml__file_read(void* context, void* buffer, size_t size, size_t* length)
 	{
-		FILE* fp = NULL;
+		FILE* fp = (FILE*)context;
+		return XML_FREAD(fp, buffer, size, *length);
+	}
 
-		if (XML_FOPEN(fp, filename, "r") != 0) {
-			return NULL;
+	static void xml__file_close(void* context)
+	{
+		FILE* fp = (FILE*)context;
+		XML_FCLOSE(fp);
+	}
+
+#if defined(XML_GZIP) || defined(XML_ZSTD)
+	/* Reader that decompresses the blocks of another reader, the input is kept between calls. */
+	struct xml__decoder {
+		xml_reader_t source;
+		xml_allocator_t allocator;
+		xml_compression_t compression;
+		int eof, done;
+		size_t in_pos, in_len;
+#ifdef XML_GZIP
+		z_stream zs;
+#endif
+#ifdef XML_ZSTD
+		ZSTD_DStream* zds;
+#endif
+		uint8_t in[XML_BUFFER_SIZE];
+	};
+
+	static int xml__decoder_fill(struct xml__decoder* decoder)
+	{
+		size_t length = 0;
+		int code = decoder->source.read(decoder->source.context, decoder->in, sizeof(decoder->in), &length);
+		if (code != 0) return code;
+		decoder->in_pos = 0;
+		decoder->in_len = length;
+		decoder->eof = length == 0;
+		return 0;
+	}
+
+#ifdef XML_GZIP
+	static voidpf xml__zalloc(voidpf opaque, uInt items, uInt size)
+	{
+		return xml__alloc((const xml_allocator_t*)opaque, NULL, (size_t)items * size);
+	}
+
+	static void xml__zfree(voidpf opaque, voidpf ptr)
+	{
+		xml__dealloc((const xml_allocator_t*)opaque, ptr);
+	}
+#endif
+
+	static int xml__decoder_read(void* context, void* buffer, size_t size, size_t* length)
+	{
+		struct xml__decoder* decoder = (struct xml__decoder*)context;
+		*length = 0;
+
+		if (decoder->compression == XML_COMPRESSION_NONE) {
+			// Hand over what was read to detect the compression, then read straight into the buffer
+			if (decoder->in_pos == decoder->in_len) return decoder->source.read(decoder->source.context, buffer, size, length);
+			*length = decoder->in_len - decoder->in_pos < size ? decoder->in_len - decoder->in_pos : size;
+			memcpy(buffer, decoder->in + decoder->in_pos, *length);
+			decoder->in_pos += *length;
+			return 0;
 		}
 
-		xml_t* xml = (xml_t*)XML_REALLOC(NULL, NULL, sizeof(xml_t));
-		if (xml == NULL) {
-			fprintf(stderr, "PANIC: Failed to allocate memory for svg structure.");
-			exit(-1);
+		while (*length == 0 && !decoder->done) {
+			if (decoder->in_pos == decoder->in_len && !decoder->eof) {
+				int code = xml__decoder_fill(decoder);
+				if (code != 0) return code;
+			}
+			int more = decoder->in_pos < decoder->in_len;
+#ifdef XML_GZIP
+			if (decoder->compression == XML_COMPRESSION_GZIP) {
+				if (decoder->zs.next_in == NULL) {
+					// The previous member has ended, a gzip file may hold several and anything else is ignored
+					if (!more) {
+						decoder->done = 1;
+						break;
+					}
+					if (decoder->in[decoder->in_pos] != 0x1f || inflateReset(&decoder->zs) != Z_OK) {
+						decoder->done = 1;
+						break;
+					}
+				}
+				decoder->zs.next_in = decoder->in + decoder->in_pos;
+				decoder->zs.avail_in = (uInt)(decoder->in_len - decoder->in_pos);
+				decoder->zs.next_out = (Bytef*)buffer;
+				decoder->zs.avail_out = size < 0x40000000 ? (uInt)size : 0x40000000;
+				int code = inflate(&decoder->zs, Z_NO_FLUSH);
+				decoder->in_pos = decoder->in_len - decoder->zs.avail_in;
+				*length = (size_t)((uint8_t*)decoder->zs.next_out - (uint8_t*)buffer);
+				if (code == Z_STREAM_END) decoder->zs.next_in = NULL;
+				else if (code == Z_BUF_ERROR && !more && decoder->eof) return Z_DATA_ERROR;
+				else if (code != Z_OK && code != Z_BUF_ERROR) return code;
+			}
+#endif
+#ifdef XML_ZSTD
+			if (decoder->compression == XML_COMPRESSION_ZSTD) {
+				ZSTD_inBuffer in = { decoder->in, decoder->in_len, decoder->in_pos };
+				ZSTD_outBuffer out = { buffer, size, 0 };
+				size_t code = ZSTD_decompressStream(decoder->zds, &out, &in);
+				if (ZSTD_isError(code)) return (int)(0 - code);
+				decoder->in_pos = in.pos;
+				*length = out.pos;
+				if (*length == 0 && !more && decoder->eof) {
+					// A frame that is cut is an error, the end of the last frame is the end of the input
+					if (code != 0) return -1;
+					decoder->done = 1;
+				}
+			}
+#endif
 		}
+		return 0;
+	}
 
-		xml->stack = (uint8_t*)calloc(STACK_SIZE, sizeof(uint8_t));
-		if (xml->stack == NULL) {
-			fprintf(stderr, "PANIC: Failed to allocate memory for svg stack.");
+	static void xml__decoder_close(void* context)
+	{
+		struct xml__decoder* decoder = (struct xml__decoder*)context;
+#ifdef XML_GZIP
+		if (decoder->compression == XML_COMPRESSION_GZIP) inflateEnd(&decoder->zs);
+#endif
+#ifdef XML_ZSTD
+		if (decoder->compression == XML_COMPRESSION_ZSTD) ZSTD_freeDStream(decoder->zds);
+#endif
+		if (decoder->source.close != NULL) decoder->source.close(decoder->source.context);
+		xml_allocator_t allocator = decoder->allocator;
+		xml__dealloc(&allocator, decoder);
+	}
+
+	/* Put a decoder in front of the reader, the first block is read to detect the compression. */
+	static int xml__decoder_open(xml_reader_t* reader, xml_compression_t compression, const xml_allocator_t* allocator)
+	{
+		struct xml__decoder* decoder = (struct xml__decoder*)xml__alloc(allocator, NULL, sizeof(struct xml__decoder));
+		if (decoder == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml decoder.");
 			exit(-1);
 		}
+		decoder->source = *reader;
+		decoder->allocator = *allocator;
+		decoder->eof = decoder->done = 0;
+		decoder->in_pos = decoder->in_len = 0;
+
+		if (xml__decoder_fill(decoder) != 0) {
+			xml__dealloc(allocator, decoder);
+			return 0;
+		}
+		const uint8_t* in = decoder->in;
+		if (compression == XML_COMPRESSION_AUTO) {
+			compression = XML_COMPRESSION_NONE;
+#ifdef XML_GZIP
+			if (decoder->in_len >= 2 && in[0] == 0x1f && in[1] == 0x8b) compression = XML_COMPRESSION_GZIP;
+#endif
+#ifdef XML_ZSTD
+			if (decoder->in_len >= 4 && in[0] == 0x28 && in[1] == 0xb5 && in[2] == 0x2f && in[3] == 0xfd) compression = XML_COMPRESSION_ZSTD;
+#endif
+		}
+		decoder->compression = compression;
+
+		int ok = compression == XML_COMPRESSION_NONE;
+#ifdef XML_GZIP
+		if (compression == XML_COMPRESSION_GZIP) {
+			memset(&decoder->zs, 0, sizeof(decoder->zs));
+			decoder->zs.zalloc = xml__zalloc;
+			decoder->zs.zfree = xml__zfree;
+			decoder->zs.opaque = &decoder->allocator;
+			// 15 + 16 reads the gzip header, next_in is NULL between members
+			ok = inflateInit2(&decoder->zs, 15 + 16) == Z_OK;
+			decoder->zs.next_in = decoder->in;
+		}
+#endif
+#ifdef XML_ZSTD
+		if (compression == XML_COMPRESSION_ZSTD) {
+			decoder->zds = ZSTD_createDStream();
+			ok = decoder->zds != NULL && !ZSTD_isError(ZSTD_initDStream(decoder->zds));
+			if (!ok && decoder->zds != NULL) ZSTD_freeDStream(decoder->zds);
+		}
+#endif
+		if (!ok) {
+			xml__dealloc(allocator, decoder);
+			return 0;
+		}
+
+		reader->context = decoder;
+		reader->read = xml__decoder_read;
+		reader->close = xml__decoder_close;
+		return 1;
+	}
+#endif
+
+	/* Open a file as a reader, with a decoder in front of it when the compression is compiled in. */
+	static int xml__open_file(xml_reader_t* reader, const char* filename, xml_compression_t compression, const xml_allocator_t* allocator)
+	{
+		FILE* fp = NULL;
+		const char* mode = "r";
+
+#if !defined(XML_GZIP) && !defined(XML_ZSTD)
+		(void)allocator;
+		if (compression != XML_COMPRESSION_AUTO && compression != XML_COMPRESSION_NONE) return 0;
+#else
+#ifndef XML_GZIP
+		if (compression == XML_COMPRESSION_GZIP) return 0;
+#endif
+#ifndef XML_ZSTD
+		if (compression == XML_COMPRESSION_ZSTD) return 0;
+#endif
+		// Compressed files are binary, plain files keep the text mode that xml_fopen has always used
+		if (compression != XML_COMPRESSION_NONE) mode = "rb";
+#endif
+		if (XML_FOPEN(fp, filename, mode) != 0) {
+			return 0;
+		}
 
+		reader->context = fp;
+		reader->read = xml__file_read;
+		reader->close = xml__file_close;
+#if defined(XML_GZIP) || defined(XML_ZSTD)
+		if (compression != XML_COMPRESSION_NONE && !xml__decoder_open(reader, compression, allocator)) {
+			xml__file_close(fp);
+			return 0;
+		}
+#endif
+		return 1;
+	}
+
+	static const xml_allocator_t xml__default_allocator = { NULL, NULL, NULL };
+
+	/* Start over on a new source, the memory that the tokenizer has grown is kept. */
+	static void xml__init(xml_t* xml, const xml_reader_t* reader, const char* data, size_t size)
+	{
+		if (data == NULL) {
+			if (xml->buffer == NULL) {
+				xml->buffer = (uint8_t*)xml__alloc(&xml->allocator, NULL, XML_BUFFER_SIZE);
+				if (xml->buffer == NULL) {
+					fprintf(stderr, "PANIC: Failed to allocate memory for xml input buffer.");
+					exit(-1);
+				}
+				xml->buffer_capacity = XML_BUFFER_SIZE;
+			}
+			xml->in = xml->buffer;
+			xml->in_len = 0;
+			xml->in_capacity = XML_BUFFER_SIZE;
+			xml->resident = 0;
+		}
+		else {
+			xml->in = (uint8_t*)data;
+			xml->in_len = size;
+			xml->in_capacity = 0;
+			xml->resident = 1;
+		}
+
+		xml->reader = *reader;
+		xml->in_base = 0;
+		xml->in_pos = 0;
+		xml->span = NULL;
+		xml->span_end = NULL;
 		xml->lc = xml__start;
 		xml->col = 1;
 		xml->row = 1;
 		xml->sc = 0;
-		xml->fp = fp;
 		xml->level = 0;
 		xml->flags = (1 << FLAG_TRIM) | (1 << FLAG_COLLAPSE);
+		xml->refs = 0;
 		xml->xml_space_count = 0;
+		xml->push_final = 0;
+		xml->starved = 0;
+		xml->save_floor = 0;
+		if (xml->filter != NULL) xml->filter->frame_count = 0;
+		XML__STAT(memset(&xml->stats, 0, sizeof(xml_stats_t)); xml->stats_depth = 0);
+	}
+
+	static xml_t* xml__create(const xml_reader_t* reader, const char* data, size_t size, const xml_allocator_t* allocator)
+	{
+		xml_t* xml = (xml_t*)xml__alloc(allocator, NULL, sizeof(xml_t));
+		if (xml == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for svg structure.");
+			exit(-1);
+		}
+
+		xml->allocator = *allocator;
+		xml->stack = (uint8_t*)xml__alloc(allocator, NULL, STACK_SIZE);
+		if (xml->stack == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for svg stack.");
+			exit(-1);
+		}
+
+		xml->buffer = NULL;
 		xml->stack_capacity = STACK_SIZE;
+		xml->cstr[0] = xml->cstr[1] = NULL;
+		xml->cstr_capacity[0] = xml->cstr_capacity[1] = 0;
+		xml->parallel = NULL;
+		xml->ahead = NULL;
+		xml->batch = NULL;
+		xml->batch_count = xml->batch_max = 0;
+		xml->strings = NULL;
+		xml->strings_len = xml->strings_capacity = 0;
+		xml->symbols = xml->own_symbols = NULL;
+		xml->filter = NULL;
+		xml->push = 0;
+		xml->buffer_capacity = xml->save_capacity = 0;
+		xml->save_stack = NULL;
+#ifdef XML__X86
+		xml->kernels = xml__has_avx2() ? &xml__kernels_avx2 : &xml__kernels_sse2;
+#else
+		xml->kernels = &xml__kernels_scalar;
+#endif
+		xml__init(xml, reader, data, size);
 
 		return xml;
 	}
 
-	xml_token_t xml_next_token(xml_t* xml)
+	xml_t* xml_open_reader(const xml_reader_t* reader)
 	{
-	jp: switch (xml->lc) {
-		LABEL(xml__start);
-		NEXTCH();
-		if (xml->ch == 0xEF) for (int i = 0; i < 3; i++) NEXTCH(); // Ignore BOM
-		xml->col = 1;
-		CALL(xml__c1, xml__padding);
-		if (xml->ch == '<') {
-			NEXTCH();
-			if (xml->ch == '?') {
-				NEXTCH();
-				CALL(xml__c2, xml__name);
-				if (xml__strncmp(xml__pop_str(xml), "xml", 3) != 0) JMP(xml__error);
-				CALL(xml__c3, xml__padding);
-				while (xml->ch != '?') {
-					CALL(xml__c9, xml__attr);
-					TOK(xml__t2, XML_DECLARATION);
-					xml__pop_str(xml);
-					xml__pop_str(xml);
-					CALL(xml__c10, xml__padding);
-				}
-				NEXTCH();
-				if (xml->ch != '>') JMP(xml__error);
-				NEXTCH();
-				CALL(xml__c11, xml__padding);
-				if (xml->ch != '<') JMP(xml__error);
-				NEXTCH();
-			}
-			TOK(xml__t9, XML_START_DOCUMENT);
-			xml->ra = RET_COMMENT_OR_DOCTYPE;
-			while (xml->ra == RET_COMMENT_OR_DOCTYPE) {
-				CALL(xml__c12, xml__tag);
-			}
-		}
-		else JMP(xml__error);
-		for (;;) TOK(xml__t1, XML_END_DOCUMENT);
+		return xml__create(reader, NULL, 0, &xml__default_allocator);
+	}
+
+	xml_t* xml_open_reader_ex(const xml_reader_t* reader, const xml_allocator_t* allocator)
+	{
+		return xml__create(reader, NULL, 0, allocator);
+	}
+
+	xml_t* xml_create(void)
+	{
+		return xml_create_ex(&xml__default_allocator);
+	}
+
+	xml_t* xml_create_ex(const xml_allocator_t* allocator)
+	{
+		xml_reader_t reader = { NULL, NULL, NULL };
+		xml_t* xml = xml__create(&reader, NULL, 0, allocator);
+		xml->push = 1;
+		return xml;
+	}
+
+	int xml_feed(xml_t* xml, const void* data, size_t size, int is_final)
+	{
+		if (!xml->push || xml->push_final) return 0;
+		// Drop what has been read, but the current character, it is where the tokenizer starts over from
+		size_t keep = xml->in_pos > 0 ? xml->in_pos - 1 : 0;
+		xml->in_base += keep;
+		memmove(xml->in, xml->in + keep, xml->in_len - keep);
+		xml->in_len -= keep;
+		xml->in_pos -= keep;
+		if (xml->in_len + size > xml->buffer_capacity) {
+			size_t new_capacity = xml->buffer_capacity * 2;
+			while (xml->in_len + size > new_capacity) new_capacity *= 2;
+			uint8_t* buffer = (uint8_t*)xml__alloc(&xml->allocator, xml->buffer, new_capacity);
+			if (buffer == NULL) {
+				fprintf(stderr, "PANIC: Failed to allocate memory for xml input buffer.");
+				exit(-1);
+			}
+			xml->buffer = xml->in = buffer;
+			xml->buffer_capacity = new_capacity;
+		}
+		if (size > 0) memcpy(&xml->in[xml->in_len], data, size);
+		xml->in_len += size;
+		xml->push_final = is_final > 0;
+		return 1;
+	}
+
+	xml_t* xml_open_memory(const char* data, size_t size)
+	{
+		return xml_open_memory_ex(data, size, &xml__default_allocator);
+	}
+
+	xml_t* xml_open_memory_ex(const char* data, size_t size, const xml_allocator_t* allocator)
+	{
+		xml_reader_t reader = { NULL, NULL, NULL };
+		return xml__create(&reader, data, size, allocator);
+	}
+
+#ifndef XML_NO_MMAP
+	struct xml__mapping {
+		void* data;
+		size_t size;
+#ifdef _WIN32
+		HANDLE file, mapping;
+#endif
+	};
+
+	static void xml__mapping_close(void* context)
+	{
+		struct xml__mapping* mapping = (struct xml__mapping*)context;
+#ifdef _WIN32
+		if (mapping->data != NULL) UnmapViewOfFile(mapping->data);
+		if (mapping->mapping != NULL) CloseHandle(mapping->mapping);
+		CloseHandle(mapping->file);
+#else
+		if (mapping->data != NULL) munmap(mapping->data, mapping->size);
+#endif
+		XML_FREE(NULL, mapping);
+	}
+
+	static struct xml__mapping* xml__map_file(const char* filename)
+	{
+		struct xml__mapping* mapping = (struct xml__mapping*)XML_REALLOC(NULL, NULL, sizeof(struct xml__mapping));
+		if (mapping == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml mapping.");
+			exit(-1);
+		}
+		mapping->data = NULL;
+		mapping->size = 0;
+
+#ifdef _WIN32
+		LARGE_INTEGER size;
+		mapping->mapping = NULL;
+		mapping->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (mapping->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapping->file, &size)) {
+			if (mapping->file != INVALID_HANDLE_VALUE) CloseHandle(mapping->file);
+			XML_FREE(NULL, mapping);
+			return NULL;
+		}
+		mapping->size = (size_t)size.QuadPart;
+		if (mapping->size > 0) {
+			mapping->mapping = CreateFileMappingA(mapping->file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping->mapping != NULL) mapping->data = MapViewOfFile(mapping->mapping, FILE_MAP_READ, 0, 0, 0);
+			if (mapping->data == NULL) {
+				xml__mapping_close(mapping);
+				return NULL;
+			}
+		}
+#else
+		struct stat st;
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			if (fd >= 0) close(fd);
+			XML_FREE(NULL, mapping);
+			return NULL;
+		}
+		mapping->size = (size_t)st.st_size;
+		if (mapping->size > 0) {
+			mapping->data = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping->data == MAP_FAILED) {
+				close(fd);
+				XML_FREE(NULL, mapping);
+				return NULL;
+			}
+#ifdef MADV_SEQUENTIAL
+			// Only declared with the BSD and GNU extensions, which a strict C99 build leaves out
+			madvise(mapping->data, mapping->size, MADV_SEQUENTIAL);
+#endif
+		}
+		close(fd);
+#endif
+		return mapping;
+	}
+
+	xml_t* xml_open_mmap(const char* filename)
+	{
+		struct xml__mapping* mapping = xml__map_file(filename);
+		if (mapping == NULL) return NULL;
+		xml_reader_t reader = { mapping, NULL, xml__mapping_close };
+		return xml__create(&reader, (const char*)mapping->data, mapping->size, &xml__default_allocator);
+	}
+#endif
+
+	xml_t* xml_fopen(const char* filename)
+	{
+		return xml_fopen_ex(filename, &xml__default_allocator);
+	}
+
+	xml_t* xml_fopen_ex(const char* filename, const xml_allocator_t* allocator)
+	{
+		return xml_fopen_compressed(filename, XML_COMPRESSION_AUTO, allocator);
+	}
+
+	xml_t* xml_fopen_compressed(const char* filename, xml_compression_t compression, const xml_allocator_t* allocator)
+	{
+		xml_reader_t reader;
+
+		if (!xml__open_file(&reader, filename, compression, allocator)) {
+			return NULL;
+		}
+
+		return xml__create(&reader, NULL, 0, allocator);
+	}
+
+	static int xml__parallel_find(xml_t* xml);
+	static int xml__replay(xml_t* xml);
+	static void xml__tokens_next(xml_t* xml);
+	static int xml__tokens_skip(xml_t* xml);
+	static int xml__skip_element(xml_t* xml);
+	static int xml__batch_add(xml_t* xml, xml_token_t token);
+	static int xml__filter_token(xml_t* xml, xml_token_t token);
+
+	/* Pass a token through the filter and the batch, returns non-zero when the tokenizer shall return it. */
+	static int xml__emit(xml_t* xml, xml_token_t token)
+	{
+		int emit = (xml->filter == NULL || xml__filter_token(xml, token)) && (xml->batch == NULL || xml__batch_add(xml, token));
+		if (!emit && xml->push && !xml->starved) xml__save(xml);
+		return emit;
+	}
+
+	/* Move to the next '<' without reading the text before it, for the elements that a filter leaves out. */
+	static int xml__discard_text(xml_t* xml)
+	{
+		while (xml->ch != '<') {
+			const uint8_t* p = &xml->in[xml->in_pos];
+			const uint8_t* end = &xml->in[xml->in_len];
+			const uint8_t* lt = (const uint8_t*)memchr(p, '<', end - p);
+			if (lt != NULL) {
+				xml__advance(xml, p, lt + 1);
+				xml->in_pos = (size_t)(lt + 1 - xml->in);
+				xml->ch = '<';
+				return 1;
+			}
+			xml__advance(xml, p, end);
+			xml->in_pos = xml->in_len;
+			if (!xml__nextch(xml)) return 0;
+		}
+		return 1;
+	}
+
+	xml_token_t xml_next_token(xml_t* xml)
+	{
+		if (xml->push) xml__save(xml);
+		XML__STAT(xml->stats_stamp = xml__cycles());
+	jp: switch (xml->lc) {
+		case xml__start:
+		NEXTCH();
+		if (xml->ch == 0xEF) for (int i = 0; i < 3; i++) NEXTCH(); // Ignore BOM
+		xml->col = 1;
+		CALL(xml__c1, xml__padding);
+		if (xml->ch == '<') {
+			NEXTCH();
+			if (xml->ch == '?') {
+				NEXTCH();
+				CALL(xml__c2, xml__name);
+				if (!xml__view_prefix(xml__pop_str(xml), "xml", 3)) JMP(xml__error);
+				CALL(xml__c3, xml__padding);
+				while (xml->ch != '?') {
+					CALL(xml__c9, xml__attr);
+					TOK(xml__t2, XML_DECLARATION);
+					xml__pop_str(xml);
+					xml__pop_str(xml);
+					CALL(xml__c10, xml__padding);
+				}
+				NEXTCH();
+				if (xml->ch != '>') JMP(xml__error);
+				NEXTCH();
+				CALL(xml__c11, xml__padding);
+				if (xml->ch != '<') JMP(xml__error);
+				NEXTCH();
+			}
+			TOK(xml__t9, XML_START_DOCUMENT);
+			xml->ra = RET_COMMENT_OR_DOCTYPE;
+			while (xml->ra == RET_COMMENT_OR_DOCTYPE) {
+				CALL(xml__c12, xml__tag);
+			}
+		}
+		else JMP(xml__error);
+		for (;;) TOK(xml__t1, XML_END_DOCUMENT);
+
+		LABEL(xml__subtree); // An element on its own, for the workers of xml_set_threads
+		CALL(xml__c25, xml__tag);
+		for (;;) TOK(xml__t13, XML_END_DOCUMENT);
+
+		LABEL(xml__tokens); // The tokens of a cache file, from xml_open_tokens
+		for (;;) {
+			xml__tokens_next(xml);
+			TOK(xml__t14, (xml_token_t)xml->replay_token);
+		}
 
 		LABEL(xml__padding);
-		while (xml->ch == ' ' || xml->ch == '\r' || xml->ch == '\n' || xml->ch == '\t' || xml->ch == '\f') NEXTCH();
+		while (xml->ch == ' ' || xml->ch == '\r' || xml->ch == '\n' || xml->ch == '\t' || xml->ch == '\f') {
+			const uint8_t* p = &xml->in[xml->in_pos - 1];
+			const uint8_t* stop = xml__skip_ws(xml, p + 1, &xml->in[xml->in_len], 1);
+			xml__advance(xml, p + 1, stop);
+			xml->in_pos = (size_t)(stop - xml->in);
+			NEXTCH();
+		}
 		RET();
 
 		LABEL(xml__name);
 		{
 			enum xml__label lc = *((enum xml__label*)xml__pop(xml, sizeof(enum xml__label)));
 			int sc = xml->sc;
+			const uint8_t* begin = &xml->in[xml->in_pos - 1];
 			if (xml->ch > 127 || xml__isalnum(xml->ch) || xml->ch == '_') {
-				uint8_t ch = xml->ch;
-				xml__push(xml, &ch, sizeof(uint8_t));
+				if (!xml->resident) {
+					uint8_t ch = xml->ch;
+					xml__push(xml, &ch, sizeof(uint8_t));
+				}
 				NEXTCH();
 			}
 			else JMP(xml__error);
-			while (xml->ch > 127 || xml__isalnum(xml->ch) || xml->ch == '_' || xml->ch == ':' || xml->ch == '-' || xml->ch == '.') {
-				uint8_t ch = xml->ch;
-				xml__push(xml, &ch, sizeof(uint8_t));
+			while (xml__isname((uint8_t)xml->ch)) {
+				const uint8_t* p = &xml->in[xml->in_pos - 1];
+				const uint8_t* stop = xml__scan_name(p + 1, &xml->in[xml->in_len]);
+				if (!xml->resident) xml__push(xml, p, stop - p);
+				xml__advance(xml, p + 1, stop);
+				xml->in_pos = (size_t)(stop - xml->in);
 				NEXTCH();
 			}
-			uint8_t n = '\0';
-			uint8_t prefix = 'n';
-			xml__push(xml, &n, sizeof(uint8_t));
-			int len = (int)(xml->sc - sc);
-			xml__push(xml, &len, sizeof(int));
-			xml__push(xml, &prefix, sizeof(uint8_t));
+			if (xml->resident) {
+				xml__push_ref(xml, begin, (int)(&xml->in[xml->in_pos - 1] - begin), 'N');
+			}
+			else {
+				uint8_t n = '\0';
+				uint8_t prefix = 'n';
+				xml__push(xml, &n, sizeof(uint8_t));
+				int len = (int)(xml->sc - sc);
+				xml__push(xml, &len, sizeof(int));
+				xml__push(xml, &prefix, sizeof(uint8_t));
+			}
 			xml__push(xml, &lc, sizeof(enum xml__label));
 			RET();
 		}
@@ -458,24 +2038,38 @@ extern "C" {
 			if (xml->ch != '\'' && xml->ch != '\"') JMP(xml__error);
 			NEXTCH();
 			xml->rc = xml->sc;
+			xml->refs = 0;
+			xml->span = xml->resident ? &xml->in[xml->in_pos - 1] : NULL;
 			while (xml->ch != xml->rb) {
-				if (xml->ch == '&') {
+				if (xml->ch == '&' && (xml->flags & (1 << FLAG_LAZY)) == 0) {
+					xml__flush_span(xml, &xml->in[xml->in_pos - 1]);
 					CALL(xml__c22, xml__escape_sign);
 				}
 				else {
-					char ch = xml->ch;
-					xml__push(xml, &ch, sizeof(uint8_t));
+					// In lazy mode a reference is kept as it is and decoded when the value is read
+					if (xml->ch == '&') xml->refs = 1;
+					const uint8_t* p = &xml->in[xml->in_pos - 1];
+					const uint8_t* stop = xml__scan_value(p + 1, &xml->in[xml->in_len], xml->rb);
+					if (xml->span == NULL) xml__push(xml, p, stop - p);
+					xml__advance(xml, p + 1, stop);
+					xml->in_pos = (size_t)(stop - xml->in);
 					NEXTCH();
 				}
 			}
-			NEXTCH();
-			uint8_t n = '\0';
-			uint8_t postfix = 'v';
 			enum xml__label lc = (enum xml__label)xml->ra;
-			xml__push(xml, &n, sizeof(uint8_t));
-			int len = (int)(xml->sc - xml->rc);
-			xml__push(xml, &len, sizeof(int));
-			xml__push(xml, &postfix, sizeof(uint8_t));
+			if (xml->span != NULL) {
+				xml__push_ref(xml, xml->span, (int)(&xml->in[xml->in_pos - 1] - xml->span), xml->refs ? 'V' | POSTFIX_REFS : 'V');
+				xml->span = NULL;
+			}
+			else {
+				uint8_t n = '\0';
+				uint8_t postfix = xml->refs ? 'v' | POSTFIX_REFS : 'v';
+				xml__push(xml, &n, sizeof(uint8_t));
+				int len = (int)(xml->sc - xml->rc);
+				xml__push(xml, &len, sizeof(int));
+				xml__push(xml, &postfix, sizeof(uint8_t));
+			}
+			NEXTCH();
 			xml__push(xml, &lc, sizeof(enum xml__label));
 			RET();
 		}
@@ -483,23 +2077,13 @@ extern "C" {
 		LABEL(xml__attr);
 		{
 			CALL(xml__c4, xml__name);
-			{
-				const char* name = xml__pop_str(xml);
-				enum xml__label lc = *((enum xml__label*)xml__pop(xml, sizeof(enum xml__label)));
-				xml__push_str(xml, name, 'n');
-				xml__push(xml, &lc, sizeof(enum xml__label));
-			}
+			xml__rotate_label(xml);
 			CALL(xml__c5, xml__padding);
 			if (xml->ch == '=') {
 				NEXTCH();
 				CALL(xml__c6, xml__padding);
 				CALL(xml__c7, xml__value);
-				{
-					const char* value = xml__pop_str(xml);
-					enum xml__label lc = *((enum xml__label*)xml__pop(xml, sizeof(enum xml__label)));
-					xml__push_str(xml, value, 'v');
-					xml__push(xml, &lc, sizeof(enum xml__label));
-				}
+				xml__rotate_label(xml);
 				CALL(xml__c8, xml__padding);
 			}
 			else {
@@ -547,7 +2131,6 @@ extern "C" {
 					NEXTCH();
 					uint8_t n = '\0';
 					xml__push(xml, &n, sizeof(uint8_t));
-					int cnt = xml->sc - sc;
 					xml->sc = sc;
 					if (xml__strncmp((const char*)&xml->stack[xml->sc], "CDATA", 5) == 0) {
 						uint8_t m1 = xml->ch;
@@ -577,7 +2160,7 @@ extern "C" {
 				else if (xml->ch == 'D') {
 					{
 						const char doctype[] = "OCTYPE";
-						for (int i = 0; i < sizeof(doctype) - 1; i++) {
+						for (size_t i = 0; i < sizeof(doctype) - 1; i++) {
 							NEXTCH();
 							if (xml->ch != doctype[i]) JMP(xml__error);
 						}
@@ -608,12 +2191,12 @@ extern "C" {
 			TOK(xml__t10, XML_START_ATTRIBUTES);
 			while (xml->ch != '>' && xml->ch != '/') {
 				CALL(xml__c15, xml__attr);
-				if (xml__strncmp(xml_get_name(xml), "xml:space", 9) == 0) {
+				if (xml__view_prefix(xml_get_name_view(xml), "xml:space", 9)) {
 					if (xml->xml_space_count > (XML_SPACE_STACK_SIZE - 1)) {
 						fprintf(stderr, "PANIC Maximum %d number of xml:space attribute have been reached.", XML_SPACE_STACK_SIZE);
 						exit(-1);
 					}
-					if (xml__strncmp(xml_get_value(xml), "preserve", 8) == 0) {
+					if (xml__view_prefix(xml_get_value_view(xml), "preserve", 8)) {
 						struct xml__xml_space xsp = { xml->level, (xml->flags & (1 << FLAG_PRESERVE)) > 0 };
 						xml->xml_space_stack[xml->xml_space_count++] = xsp;
 						xml->flags |= (1 << FLAG_PRESERVE);
@@ -636,57 +2219,102 @@ extern "C" {
 				TOK(xml__t5, XML_END_TAG);
 				xml__restore_xml_space_stack(xml);
 				xml__pop_str(xml);
+				xml->ra = RET_TAG_END;
 				RET();
 			}
 			xml__pop_str(xml);
 			xml->ra = xml->sc;
+			xml->refs = 0;
 			LABEL(xml__tag_loop);
 			if (xml->ch == '>') NEXTCH();
 			if (xml->flags & (1 << FLAG_TRIM) && ((xml->flags & (1 << FLAG_PRESERVE)) == 0)) {
 				CALL(xml__c24, xml__padding); // Padding
 			}
 			LABEL(xml__tag_loop_no_trim);
+			if ((xml->flags & (1 << FLAG_DISCARD)) && !xml__discard_text(xml)) JMP(xml__error_loop);
 			xml->rb = '\0';
+			xml->span = (xml->resident && xml->sc == xml->ra) ? &xml->in[xml->in_pos - 1] : NULL;
 			while (xml->ch != '<') {
-				if (xml->ch == '&') {
+				if (xml->ch == '&' && (xml->flags & (1 << FLAG_LAZY)) == 0) {
+					xml__flush_span(xml, &xml->in[xml->in_pos - 1]);
 					CALL(xml__c23, xml__escape_sign);
 					xml->rb = *(uint8_t*)xml__peek(xml, sizeof(uint8_t), 0);
 				}
 				else {
-					if (xml->flags & (1 << FLAG_COLLAPSE) && ((xml->flags & (1 << FLAG_PRESERVE)) == 0)) {
-						if (xml->ch == '\n' || xml->ch == '\r' || xml->ch == '\t') {
-							xml->ch = ' ';
+					if (xml->ch == '&') xml->refs = 1;
+					int collapse = xml->flags & (1 << FLAG_COLLAPSE) && ((xml->flags & (1 << FLAG_PRESERVE)) == 0);
+					const uint8_t* p = &xml->in[xml->in_pos - 1];
+					const uint8_t* end = &xml->in[xml->in_len];
+					const uint8_t* stop = xml__scan_text(xml, p, end, collapse, xml->rb);
+					if (stop != p) {
+						// Bulk copy the clean run, then continue at the byte that stopped the kernel
+						if (xml->span == NULL) xml__push(xml, p, stop - p);
+						if (collapse) xml->rb = stop[-1];
+						if (stop < end) {
+							xml__advance(xml, p + 1, stop + 1);
+							xml->in_pos = (size_t)(stop + 1 - xml->in);
+							xml->ch = *stop;
+							continue;
 						}
-						if (!(xml->ch == ' ' && xml->rb == ' ')) {
+						xml__advance(xml, p + 1, end);
+						xml->in_pos = xml->in_len;
+						NEXTCH();
+						continue;
+					}
+					if (collapse && (xml->ch == ' ' || xml->ch == '\n' || xml->ch == '\r' || xml->ch == '\t')) {
+						// Collapse the whole run of white-space into one space, a lone space is kept as it is
+						stop = xml__skip_ws(xml, p + 1, end, 0);
+						if (xml->ch != ' ' || xml->rb == ' ' || stop != p + 1) xml__flush_span(xml, p);
+						if (xml->rb != ' ' && xml->span == NULL) {
+							uint8_t ch = ' ';
+							xml__push(xml, &ch, sizeof(uint8_t));
+						}
+						xml->rb = ' ';
+						xml__advance(xml, p + 1, stop);
+						xml->in_pos = (size_t)(stop - xml->in);
+						NEXTCH();
+						continue;
+					}
+					if (collapse) {
+						if (xml->span == NULL) {
 							uint8_t ch = xml->ch;
 							xml__push(xml, &ch, sizeof(uint8_t));
 						}
 						xml->rb = xml->ch;
 					}
-					else {
+					else if (xml->span == NULL) {
 						uint8_t ch = xml->ch;
 						xml__push(xml, &ch, sizeof(uint8_t));
 					}
 					NEXTCH();
 				}
 			}
+			xml->span_end = &xml->in[xml->in_pos - 1];
 			NEXTCH();
-			if (xml->ch != '!' && (xml->flags & (1 << FLAG_TRIM) && ((xml->flags & (1 << FLAG_PRESERVE)) == 0) && xml->sc != xml->ra)) {
-				char ch = xml->stack[xml->sc - 1];
-				while (xml->sc > 0 && (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\f' || ch == '\t')) {
-					ch = xml->stack[--(xml->sc) - 1];
+			if (xml->ch != '!' && (xml->flags & (1 << FLAG_TRIM) && ((xml->flags & (1 << FLAG_PRESERVE)) == 0))) {
+				if (xml->span != NULL) {
+					xml->span_end = xml->kernels->trim_ws(xml->span, xml->span_end);
+				}
+				else if (xml->sc != xml->ra) {
+					xml->sc = (int)(xml->kernels->trim_ws(&xml->stack[xml->ra], &xml->stack[xml->sc]) - xml->stack);
+					if (xml->sc < xml->save_floor) xml__keep_stack(xml);
 				}
 			}
+			LABEL(xml__skip_end);
 			if (xml->ch == '/') {
-				{
+				if (xml->span != NULL) {
+					xml__push_ref(xml, xml->span, (int)(xml->span_end - xml->span), xml->refs ? 'T' | POSTFIX_REFS : 'T');
+					xml->span = NULL;
+				}
+				else {
 					uint8_t n = '\0';
-					uint8_t postfix = 't';
+					uint8_t postfix = xml->refs ? 't' | POSTFIX_REFS : 't';
 					xml__push(xml, &n, sizeof(uint8_t));
 					int len = (int)(xml->sc - xml->ra);
 					xml__push(xml, &len, sizeof(int));
 					xml__push(xml, &postfix, sizeof(uint8_t));
 				}
-				if (((size_t)xml->sc - xml->ra) > (sizeof(int) + 2 * sizeof(uint8_t))) TOK(xml__t6, XML_TEXT);
+				if (xml_get_text_view(xml).len > 0) TOK(xml__t6, XML_TEXT);
 				xml__pop_str(xml);
 				NEXTCH();
 				CALL(xml__c18, xml__name);
@@ -699,21 +2327,46 @@ extern "C" {
 				RET();
 			}
 			else {
+				xml__flush_span(xml, xml->span_end);
+				xml__push(xml, &xml->refs, sizeof(int));
 				xml__push(xml, &xml->ra, sizeof(int));
-				CALL(xml__c19, xml__tag);
+				if (xml__parallel_find(xml)) {
+					while (xml__replay(xml)) TOK(xml__t12, (xml_token_t)xml->replay_token);
+					xml->ra = RET_TAG_END;
+				}
+				else CALL(xml__c19, xml__tag);
 				if (xml->ra == RET_CDATA) {
-					const char* text = xml_get_text(xml);
-					xml__pop_str(xml);
+					// The text of CDATA is moved down onto the text of the element, it is on the stack above it
+					xml_strview_t cdata = xml__pop_str(xml);
+					size_t from = (size_t)((const uint8_t*)cdata.ptr - xml->stack), amps = 0;
 					xml->ra = *(int*)xml__pop(xml, sizeof(int));
-					while (*text != '\0') {
-						xml__push(xml, text, sizeof(uint8_t));
-						++text;
+					xml->refs = *(int*)xml__pop(xml, sizeof(int));
+					memmove(&xml->stack[xml->sc], &xml->stack[from], cdata.len);
+					if (xml->flags & (1 << FLAG_LAZY)) {
+						for (size_t i = 0; i < cdata.len; i++) amps += xml->stack[xml->sc + i] == '&';
+					}
+					if (amps > 0) {
+						// The text of CDATA is never decoded, so in lazy mode an ampersand is written as a reference. The
+						// text is widened from the end, so no byte is overwritten before it is read.
+						size_t i = cdata.len, j = cdata.len + 4 * amps;
+						xml__reserve(xml, j);
+						while (i > 0) {
+							uint8_t ch = xml->stack[xml->sc + --i];
+							if (ch == '&') {
+								j -= 5;
+								memcpy(&xml->stack[xml->sc + j], "&amp;", 5);
+							}
+							else xml->stack[xml->sc + --j] = ch;
+						}
+						xml->refs = 1;
 					}
+					xml->sc += (int)(cdata.len + 4 * amps);
 					NEXTCH();
 					JMP(xml__tag_loop_no_trim);
 				}
 				else {
 					xml->ra = *(int*)xml__pop(xml, sizeof(int));
+					xml->refs = *(int*)xml__pop(xml, sizeof(int));
 					NEXTCH();
 				}
 				JMP(xml__tag_loop);
@@ -724,76 +2377,19 @@ extern "C" {
 		{
 			enum xml__label lc = *((enum xml__label*)xml__pop(xml, sizeof(enum xml__label)));
 			int sc = xml->sc;
-			uint8_t base = ' ';
 			NEXTCH();
-			if (xml->ch == '#') {
-				NEXTCH();
-				base = 'd';
-				if (xml->ch == 'x') {
-					base = 'x';
-					NEXTCH();
-				}
-			}
 			while (xml->ch != ';') {
 				uint8_t ch = xml->ch;
 				xml__push(xml, &ch, sizeof(uint8_t));
 				NEXTCH();
 			}
 			NEXTCH();
-			uint8_t n = '\0';
-			xml__push(xml, &n, sizeof(uint8_t));
-			int cnt = xml->sc - sc;
-			xml->sc -= cnt;
-			if (base == 'd') {
-				if (cnt == 2) {
-					uint8_t ch = xml->stack[xml->sc] - '0';
-					xml__push(xml, &ch, sizeof(uint8_t));
-				}
-				else if (cnt == 3) {
-					uint8_t ch = (xml->stack[xml->sc] - '0') * 10 + xml->stack[xml->sc + 1] - '0';
-					xml__push(xml, &ch, sizeof(uint8_t));
-				}
-				else if (cnt == 4) {
-					uint8_t ch = (xml->stack[xml->sc] - '0') * 100 + (xml->stack[xml->sc + 1] - '0') * 10 + xml->stack[xml->sc + 2] - '0';
-					xml__push(xml, &ch, sizeof(uint8_t));
-				}
-				else JMP(xml__error);
-			}
-			else if (base == 'x') {
-				if (cnt == 2) {
-					char a = xml__toupper(xml->stack[xml->sc]);
-					uint8_t ch = a >= 'A' ? (a - 'A' + 10) : (a - '0');
-					xml__push(xml, &ch, sizeof(uint8_t));
-				}
-				else if (cnt == 3) {
-					char a = xml__toupper(xml->stack[xml->sc]);
-					char b = xml__toupper(xml->stack[xml->sc + 1]);
-					char ch = (a >= 'A' ? (a - 'A' + 10) : (a - '0') << 4) + (b >= 'A' ? (b - 'A' + 10) : (b - '0'));
-					xml__push(xml, &ch, sizeof(uint8_t));
-				}
-				else JMP(xml__error);
-			}
-			else if (xml__strncmp((const char*)&xml->stack[xml->sc], "amp", 3) == 0) {
-				uint8_t ch = '&';
-				xml__push(xml, &ch, sizeof(uint8_t));
-			}
-			else if (xml__strncmp((const char*)&xml->stack[xml->sc], "apos", 4) == 0) {
-				uint8_t ch = '\'';
-				xml__push(xml, &ch, sizeof(uint8_t));
-			}
-			else if (xml__strncmp((const char*)&xml->stack[xml->sc], "lt", 2) == 0) {
-				uint8_t ch = '<';
-				xml__push(xml, &ch, sizeof(uint8_t));
-			}
-			else if (xml__strncmp((const char*)&xml->stack[xml->sc], "gt", 2) == 0) {
-				uint8_t ch = '>';
-				xml__push(xml, &ch, sizeof(uint8_t));
-			}
-			else if (xml__strncmp((const char*)&xml->stack[xml->sc], "quot", 4) == 0) {
-				uint8_t ch = '\"';
-				xml__push(xml, &ch, sizeof(uint8_t));
-			}
-			else JMP(xml__error);
+			uint8_t utf8[4];
+			int cnt = xml__decode_ref(&xml->stack[sc], (size_t)(xml->sc - sc), utf8);
+			xml->sc = sc;
+			if (cnt == 0) JMP(xml__error);
+			XML__STAT(xml->stats.references++);
+			for (int i = 0; i < cnt; i++) xml__push(xml, &utf8[i], sizeof(uint8_t));
 			enum xml__label llc = (enum xml__label)lc;
 			xml__push(xml, &llc, sizeof(enum xml__label));
 			RET();
@@ -816,48 +2412,1047 @@ extern "C" {
 			xml__push(xml, &len, sizeof(int));
 			xml__push(xml, &prefix, sizeof(uint8_t));
 		}
-		for (;;) TOK(xml__error_loop, XML_ERROR);
-		default: break;
+		for (;;) {
+			if (xml->starved) {
+				xml__restore(xml);
+				XML__STAT(xml->stats.tokens[XML_NEED_MORE]++);
+				return XML_NEED_MORE;
+			}
+			TOK(xml__error_loop, XML_ERROR);
+		}
+		default: break;
+	}
+	return XML_ERROR;
+	}
+
+	/* Find the end of a comment or CDATA section, the two bytes before '>' must be 'mark'. m1 and m2 are the last
+	*  two bytes before p, so that the end is found across two blocks of input.
+	*/
+	static const uint8_t* xml__skip_marked(const uint8_t* p, const uint8_t* end, uint8_t mark, uint8_t* m1, uint8_t* m2)
+	{
+		const uint8_t* begin = p;
+		const uint8_t* gt;
+		while ((gt = (const uint8_t*)memchr(p, '>', end - p)) != NULL) {
+			uint8_t b1 = gt - 1 >= begin ? gt[-1] : *m2;
+			uint8_t b2 = gt - 2 >= begin ? gt[-2] : gt - 1 >= begin ? *m2 : *m1;
+			if (b1 == mark && b2 == mark) return gt + 1;
+			p = gt + 1;
+		}
+		if (end - begin >= 2) {
+			*m1 = end[-2];
+			*m2 = end[-1];
+		}
+		else if (end - begin == 1) {
+			*m1 = *m2;
+			*m2 = end[-1];
+		}
+		return NULL;
+	}
+
+	static int xml__skip_element(xml_t* xml)
+	{
+		enum { SKIP_OWN_TAG, SKIP_TAG, SKIP_QUOTE, SKIP_CONTENT, SKIP_LT, SKIP_BANG, SKIP_COMMENT, SKIP_CDATA };
+		int state, quote_state = SKIP_TAG, depth = 1, start = 0, quote = 0, prev = 0;
+		uint8_t m1 = 0, m2 = 0;
+
+		if (xml->lc == xml__t14) return xml__tokens_skip(xml);
+		if (xml->lc == xml__t12) {
+			// The element is replayed from a worker, drop its tokens up to its end tag
+			if (xml->replay_token == XML_TEXT || xml->replay_token == XML_END_TAG) return 0;
+			for (;;) {
+				const uint8_t* replay = xml->replay;
+				if (!xml__replay(xml)) return 0;
+				if (xml->replay_token == XML_START_TAG) depth++;
+				else if (xml->replay_token == XML_END_TAG && --depth == 0) {
+					xml->replay = replay;
+					return 1;
+				}
+			}
+		}
+
+		if (xml->lc == xml__t11) {
+			if (xml->ch == '/') return 1;
+			state = SKIP_CONTENT;
+		}
+		else if (xml->lc == xml__t3 || xml->lc == xml__t10 || xml->lc == xml__t4) {
+			if (xml->lc == xml__t4) {
+				xml__pop_str(xml);
+				xml__pop_str(xml);
+			}
+			if (xml->ch == '/') {
+				xml->lc = xml__t11;
+				return 1;
+			}
+			if (xml->ch == '>') state = SKIP_CONTENT;
+			else if (xml->ch == '\'' || xml->ch == '\"') {
+				quote = xml->ch;
+				quote_state = SKIP_OWN_TAG;
+				state = SKIP_QUOTE;
+			}
+			else state = SKIP_OWN_TAG;
+		}
+		else return 0;
+
+		const uint8_t* p = &xml->in[xml->in_pos];
+		const uint8_t* end = &xml->in[xml->in_len];
+		const uint8_t* begin = p;
+		for (;;) {
+			if (p == end) {
+				xml__advance(xml, begin, p);
+				xml->in_pos = xml->in_len;
+				if (!xml__fill(xml)) {
+					xml->lc = xml__error_loop;
+					return 0;
+				}
+				p = begin = xml->in;
+				end = &xml->in[xml->in_len];
+				continue;
+			}
+			switch (state) {
+			case SKIP_OWN_TAG:
+			case SKIP_TAG:
+				while (p < end && *p != '>' && *p != '\'' && *p != '\"' && !(state == SKIP_OWN_TAG && *p == '/')) prev = *p++;
+				if (p == end) break;
+				if (*p == '>') {
+					if (state == SKIP_TAG && start && prev != '/') depth++;
+					state = SKIP_CONTENT;
+					p++;
+				}
+				else if (*p == '/') {
+					// The element is empty, let the tokenizer read the end of its start tag
+					p++;
+					xml__advance(xml, begin, p);
+					xml->in_pos = (size_t)(p - xml->in);
+					xml->ch = '/';
+					xml->lc = xml__t11;
+					return 1;
+				}
+				else {
+					quote = *p++;
+					quote_state = state;
+					state = SKIP_QUOTE;
+				}
+				break;
+			case SKIP_QUOTE: {
+				const uint8_t* q = (const uint8_t*)memchr(p, quote, end - p);
+				if (q == NULL) {
+					p = end;
+					break;
+				}
+				p = q + 1;
+				prev = quote;
+				state = quote_state;
+				break;
+			}
+			case SKIP_CONTENT: {
+				const uint8_t* lt = (const uint8_t*)memchr(p, '<', end - p);
+				if (lt == NULL) {
+					p = end;
+					break;
+				}
+				p = lt + 1;
+				state = SKIP_LT;
+				break;
+			}
+			case SKIP_LT:
+				prev = *p;
+				if (*p == '/') {
+					if (--depth == 0) {
+						// At the end tag of the element, let the tokenizer read it with no text before it
+						p++;
+						xml__advance(xml, begin, p);
+						xml->in_pos = (size_t)(p - xml->in);
+						xml->ch = '/';
+						xml__pop_str(xml);
+						xml->ra = xml->sc;
+						xml->refs = 0;
+						xml->span = NULL;
+						xml->lc = xml__skip_end;
+						return 1;
+					}
+					start = 0;
+					state = SKIP_TAG;
+				}
+				else if (*p == '!') state = SKIP_BANG;
+				else {
+					start = *p != '?';
+					state = SKIP_TAG;
+				}
+				p++;
+				break;
+			case SKIP_BANG:
+				m1 = m2 = 0;
+				if (*p == '-') state = SKIP_COMMENT;
+				else if (*p == '[') state = SKIP_CDATA;
+				else {
+					start = 0;
+					state = SKIP_TAG;
+				}
+				p++;
+				break;
+			case SKIP_COMMENT:
+			case SKIP_CDATA: {
+				const uint8_t* q = xml__skip_marked(p, end, state == SKIP_COMMENT ? '-' : ']', &m1, &m2);
+				if (q == NULL) {
+					p = end;
+					break;
+				}
+				p = q;
+				state = SKIP_CONTENT;
+				break;
+			}
+			}
+		}
+	}
+
+	int xml_skip_element(xml_t* xml)
+	{
+		if (!xml->push) return xml__skip_element(xml);
+		xml__save(xml);
+		int skipped = xml__skip_element(xml);
+		if (xml->starved) {
+			xml__restore(xml);
+			return 0;
+		}
+		return skipped;
+	}
+
+	static int xml__filter_name(const struct xml__filter_step* step, xml_strview_t name)
+	{
+		return step->name == NULL || (step->len == name.len && memcmp(step->name, name.ptr, name.len) == 0);
+	}
+
+	static int xml__filter_token(xml_t* xml, xml_token_t token)
+	{
+		struct xml__filter* filter = xml->filter;
+		struct xml__filter_frame* top = filter->frame_count > 0 ? &filter->frames[filter->frame_count - 1] : NULL;
+
+		switch (token) {
+		case XML_START_TAG: {
+			struct xml__filter_frame frame = { 0, 0, XML__FILTER_MATCH };
+			if (top == NULL || top->kind != XML__FILTER_MATCH) {
+				xml_strview_t name = xml_get_name_view(xml);
+				frame.kind = XML__FILTER_SKIP;
+				for (uint64_t bits = top != NULL ? top->active : filter->start; bits != 0; bits &= bits - 1) {
+					int i = xml__ctz64(bits);
+					const struct xml__filter_step* step = &filter->steps[i];
+					if (step->descendant) frame.active |= (uint64_t)1 << i;
+					if (step->attribute) frame.attributes |= (uint64_t)1 << i;
+					else if (xml__filter_name(step, name)) {
+						if (step->last) frame.kind = XML__FILTER_MATCH;
+						else {
+							// "a//@id" also goes on to the attributes of the elements below
+							const struct xml__filter_step* next = &filter->steps[i + 1];
+							if (next->attribute) frame.attributes |= (uint64_t)1 << (i + 1);
+							if (!next->attribute || next->descendant) frame.active |= (uint64_t)1 << (i + 1);
+						}
+					}
+				}
+				if (frame.kind == XML__FILTER_SKIP && (frame.active | frame.attributes) != 0) frame.kind = XML__FILTER_PASS;
+			}
+			if (filter->frame_count == filter->frame_capacity) {
+				size_t new_capacity = filter->frame_capacity > 0 ? filter->frame_capacity * 2 : 16;
+				struct xml__filter_frame* frames = (struct xml__filter_frame*)xml__alloc(&xml->allocator, filter->frames, new_capacity * sizeof(struct xml__filter_frame));
+				if (frames == NULL) {
+					fprintf(stderr, "PANIC: Failed to allocate memory for xml filter.");
+					exit(-1);
+				}
+				filter->frames = frames;
+				filter->frame_capacity = new_capacity;
+			}
+			filter->frames[filter->frame_count++] = frame;
+			if (frame.kind == XML__FILTER_PASS) xml->flags |= (1 << FLAG_DISCARD);
+			else xml->flags &= ~(1 << FLAG_DISCARD);
+			if (frame.kind == XML__FILTER_SKIP) {
+				xml__skip_element(xml);
+				return 0;
+			}
+			return 1;
+		}
+		case XML_END_TAG: {
+			if (top == NULL) return 1;
+			int kind = top->kind;
+			filter->frame_count--;
+			if (filter->frame_count > 0 && filter->frames[filter->frame_count - 1].kind == XML__FILTER_PASS) xml->flags |= (1 << FLAG_DISCARD);
+			else xml->flags &= ~(1 << FLAG_DISCARD);
+			return kind != XML__FILTER_SKIP;
+		}
+		case XML_ATTRIBUTE:
+			if (top == NULL || top->kind == XML__FILTER_MATCH) return 1;
+			for (uint64_t bits = top->attributes; bits != 0; bits &= bits - 1) {
+				if (xml__filter_name(&filter->steps[xml__ctz64(bits)], xml_get_name_view(xml))) return 1;
+			}
+			return 0;
+		case XML_TEXT:
+			return top != NULL && top->kind == XML__FILTER_MATCH;
+		case XML_DECLARATION:
+			return 0;
+		default:
+			return 1;
+		}
+	}
+
+	int xml_set_filter(xml_t* xml, const char* const* paths, size_t count)
+	{
+		if (xml->filter != NULL) {
+			if (xml->filter->frames != NULL) xml__dealloc(&xml->allocator, xml->filter->frames);
+			xml__dealloc(&xml->allocator, xml->filter->names);
+			xml__dealloc(&xml->allocator, xml->filter);
+			xml->filter = NULL;
+			xml->flags &= ~(1 << FLAG_DISCARD);
+		}
+		if (paths == NULL || count == 0) return 1;
+
+		size_t size = 0;
+		for (size_t i = 0; i < count; i++) size += xml__strlen(paths[i]) + 1;
+
+		struct xml__filter* filter = (struct xml__filter*)xml__alloc(&xml->allocator, NULL, sizeof(struct xml__filter));
+		char* names = filter != NULL ? (char*)xml__alloc(&xml->allocator, NULL, size) : NULL;
+		if (names == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml filter.");
+			exit(-1);
+		}
+		filter->step_count = filter->frame_count = filter->frame_capacity = 0;
+		filter->start = 0;
+		filter->names = names;
+		filter->frames = NULL;
+
+		for (size_t i = 0; i < count; i++) {
+			const char* path = paths[i];
+			size_t first = filter->step_count;
+			int descendant = 0;
+			if (path[0] == '/' && path[1] == '/') {
+				descendant = 1;
+				path += 2;
+			}
+			else if (path[0] == '/') path++;
+
+			for (;;) {
+				size_t len = 0;
+				while (path[len] != '/' && path[len] != '\0') len++;
+				if (len == 0 || filter->step_count == 64) goto malformed;
+
+				struct xml__filter_step* step = &filter->steps[filter->step_count++];
+				step->attribute = path[0] == '@';
+				step->descendant = descendant;
+				step->last = path[len] == '\0';
+				if (step->attribute && (!step->last || len == 1)) goto malformed;
+				if (step->attribute && !step->descendant && filter->step_count - 1 == first) goto malformed;
+				memcpy(names, path + step->attribute, len - step->attribute);
+				step->name = (len - step->attribute == 1 && names[0] == '*') ? NULL : names;
+				step->len = len - step->attribute;
+				names += step->len;
+
+				if (step->last) break;
+				path += len + 1;
+				descendant = 0;
+				if (*path == '/') {
+					descendant = 1;
+					path++;
+				}
+			}
+			filter->start |= (uint64_t)1 << first;
+		}
+
+		xml->filter = filter;
+		return 1;
+
+	malformed:
+		xml__dealloc(&xml->allocator, filter->names);
+		xml__dealloc(&xml->allocator, filter);
+		return 0;
+	}
+
+	const char* xml_get_error(xml_t* xml) {
+		if (xml->stack[xml->sc - sizeof(uint8_t)] == 'e') {
+			int cnt = *(int*)xml__peek(xml, sizeof(int), sizeof(uint8_t));
+			return (const char*)&xml->stack[(size_t)xml->sc - cnt - sizeof(int) - sizeof(uint8_t)];
+		}
+		return NULL;
+	}
+
+	/* Return the top of the string of the kind on the stack, 0 if there is none. The name of an attribute is under its value. */
+	static size_t xml__find_str(xml_t* xml, uint8_t kind)
+	{
+		if (xml->sc == 0) return 0;
+		size_t top = xml->sc;
+		uint8_t postfix = xml->stack[top - sizeof(uint8_t)] & ~POSTFIX_REFS;
+		if (kind == 'n' && (postfix | 0x20) == 'v') {
+			xml_strview_t view;
+			top -= xml__peek_view(xml, top, &view);
+			postfix = xml->stack[top - sizeof(uint8_t)] & ~POSTFIX_REFS;
+		}
+		return (postfix | 0x20) == kind ? top : 0;
+	}
+
+	static xml_strview_t xml__get_view(xml_t* xml, uint8_t kind, int* ref)
+	{
+		xml_strview_t view = { NULL, 0 };
+		size_t top = xml__find_str(xml, kind);
+		if (top > 0) {
+			uint8_t postfix = xml->stack[top - sizeof(uint8_t)] & ~POSTFIX_REFS;
+			xml__peek_view(xml, top, &view);
+			*ref = postfix >= 'A' && postfix <= 'Z';
+		}
+		return view;
+	}
+
+	static int xml__get_refs(xml_t* xml, uint8_t kind)
+	{
+		size_t top = xml__find_str(xml, kind);
+		return top > 0 && (xml->stack[top - sizeof(uint8_t)] & POSTFIX_REFS) != 0;
+	}
+
+	/* Views into a resident document are not nul-terminated, they are copied to a scratch buffer when read as a c-string.
+	*  Strings that still contain references are decoded into the scratch buffer. The length of the c-string is stored in
+	*  len when it is not NULL.
+	*/
+	static const char* xml__get_cstr(xml_t* xml, uint8_t kind, int slot, size_t* len)
+	{
+		int ref = 0;
+		xml_strview_t view = xml__get_view(xml, kind, &ref);
+		int refs = xml__get_refs(xml, kind);
+		if (len != NULL) *len = view.len;
+		if (view.ptr == NULL || (!ref && !refs)) return view.ptr;
+		if (xml->cstr_capacity[slot] < view.len + 1) {
+			char* cstr = (char*)xml__alloc(&xml->allocator, xml->cstr[slot], view.len + 1);
+			if (cstr == NULL) {
+				fprintf(stderr, "PANIC: Failed to allocate memory for xml string.");
+				exit(-1);
+			}
+			xml->cstr[slot] = cstr;
+			xml->cstr_capacity[slot] = view.len + 1;
+		}
+		if (refs) view.len = xml_decode(view.ptr, view.len, xml->cstr[slot]);
+		else memcpy(xml->cstr[slot], view.ptr, view.len);
+		xml->cstr[slot][view.len] = '\0';
+		if (len != NULL) *len = view.len;
+		return xml->cstr[slot];
+	}
+
+	const char* xml_get_name(xml_t* xml) {
+		return xml__get_cstr(xml, 'n', 0, NULL);
+	}
+
+	const char* xml_get_value(xml_t* xml) {
+		return xml__get_cstr(xml, 'v', 1, NULL);
+	}
+
+	const char* xml_get_text(xml_t* xml)
+	{
+		return xml__get_cstr(xml, 't', 1, NULL);
+	}
+
+	xml_strview_t xml_get_name_view(xml_t* xml)
+	{
+		int ref;
+		return xml__get_view(xml, 'n', &ref);
+	}
+
+	xml_strview_t xml_get_value_view(xml_t* xml)
+	{
+		int ref;
+		return xml__get_view(xml, 'v', &ref);
+	}
+
+	size_t xml_get_offset(xml_t* xml)
+	{
+		return xml->in_base + (xml->in_pos > 0 ? xml->in_pos - 1 : 0);
+	}
+
+	xml_strview_t xml_get_text_view(xml_t* xml)
+	{
+		int ref;
+		return xml__get_view(xml, 't', &ref);
+	}
+
+	size_t xml_get_name_len(xml_t* xml)
+	{
+		return xml_get_name_view(xml).len;
+	}
+
+	/* The length of the string as xml_get_value and xml_get_text return it, a view with references is decoded first. */
+	static size_t xml__get_len(xml_t* xml, uint8_t kind, int slot)
+	{
+		int ref;
+		size_t len = xml__get_view(xml, kind, &ref).len;
+		if (xml__get_refs(xml, kind)) xml__get_cstr(xml, kind, slot, &len);
+		return len;
+	}
+
+	size_t xml_get_value_len(xml_t* xml)
+	{
+		return xml__get_len(xml, 'v', 1);
+	}
+
+	size_t xml_get_text_len(xml_t* xml)
+	{
+		return xml__get_len(xml, 't', 1);
+	}
+
+	int xml_has_refs(xml_t* xml)
+	{
+		return xml__get_refs(xml, 't') || xml__get_refs(xml, 'v');
+	}
+
+	size_t xml_decode(const char* src, size_t len, char* dst)
+	{
+		size_t i = 0, n = 0;
+		while (i < len) {
+			const char* amp = (const char*)memchr(src + i, '&', len - i);
+			size_t run = amp != NULL ? (size_t)(amp - src) - i : len - i;
+			memmove(dst + n, src + i, run);
+			n += run;
+			i += run;
+			if (amp == NULL) break;
+			// References are short, the ';' is only looked for in the next 32 bytes so a stray '&' costs no more than that
+			size_t limit = len - i - 1 < 32 ? len - i - 1 : 32;
+			const char* semi = (const char*)memchr(amp + 1, ';', limit);
+			int cnt = semi != NULL ? xml__decode_ref((const uint8_t*)amp + 1, (size_t)(semi - amp) - 1, (uint8_t*)dst + n) : 0;
+			if (cnt > 0) {
+				n += cnt;
+				i = (size_t)(semi - src) + 1;
+			}
+			else {
+				dst[n++] = '&';
+				i++;
+			}
+		}
+		return n;
+	}
+
+#ifdef XML_PARALLEL
+	/* A complete element that a worker has tokenized ahead, from the '<' at begin to the position after its end tag.
+	*  The tokens are the records in the log of the chunk between log_begin and log_end. The element can only be
+	*  replayed when the tokenizer reaches begin in the same state, that is the same flags and whether it is inside
+	*  an element with a xml:space attribute.
+	*/
+	struct xml__subtree {
+		size_t begin, end, log_begin, log_end;
+		int flags, spaced;
+	};
+
+	struct xml__chunk {
+		size_t index;
+		int state;
+		struct xml__subtree* subtrees;
+		size_t count, capacity;
+		uint8_t* log;
+		size_t log_len, log_capacity;
+	};
+
+	struct xml__parallel {
+		xml_allocator_t allocator;
+		const uint8_t* in;
+		size_t in_len, chunks, first, next;
+		int threads, window, flags, started, stop;
+		struct xml__chunk* ring;
+		xml__thread_t* handles;
+		xml__mutex_t mutex;
+		xml__cond_t cond;
+	};
+
+	static void* xml__grow(const xml_allocator_t* allocator, void* ptr, size_t* capacity, size_t size, size_t item)
+	{
+		if (size <= *capacity) return ptr;
+		size_t new_capacity = *capacity > 0 ? *capacity * 2 : 64;
+		while (size > new_capacity) new_capacity *= 2;
+		ptr = xml__alloc(allocator, ptr, new_capacity * item);
+		if (ptr == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml parallel chunk.");
+			exit(-1);
+		}
+		*capacity = new_capacity;
+		return ptr;
+	}
+
+	/* Records in the log are [token][count][size_t position] followed by count strings as [postfix][int len][inline]
+	*  and then either len bytes when inline, for strings that were rewritten on the workers stack, or a pointer into
+	*  the document. The position is where the worker was in the document after the token.
+	*/
+	static void xml__record(struct xml__chunk* chunk, xml_t* wx, xml_token_t token)
+	{
+		xml_strview_t views[2];
+		int refs[2] = { 0, 0 };
+		uint8_t postfixes[2] = { 'N', 'V' };
+		uint8_t count = 1;
+		if (token == XML_TEXT) {
+			views[0] = xml__get_view(wx, 't', &refs[0]);
+			postfixes[0] = xml__get_refs(wx, 't') ? 'T' | POSTFIX_REFS : 'T';
+		}
+		else {
+			views[0] = xml__get_view(wx, 'n', &refs[0]);
+			if (token == XML_ATTRIBUTE) views[count++] = xml__get_view(wx, 'v', &refs[1]);
+			if (token == XML_ATTRIBUTE && xml__get_refs(wx, 'v')) postfixes[1] |= POSTFIX_REFS;
+		}
+		size_t size = 2 + sizeof(size_t);
+		for (int i = 0; i < count; i++) size += sizeof(uint8_t) * 2 + sizeof(int) + (refs[i] ? sizeof(const char*) : views[i].len);
+		chunk->log = (uint8_t*)xml__grow(&wx->allocator, chunk->log, &chunk->log_capacity, chunk->log_len + size, sizeof(uint8_t));
+		uint8_t* p = &chunk->log[chunk->log_len];
+		*p++ = (uint8_t)token;
+		*p++ = count;
+		memcpy(p, &wx->in_pos, sizeof(size_t));
+		p += sizeof(size_t);
+		for (int i = 0; i < count; i++) {
+			int len = (int)views[i].len;
+			*p++ = postfixes[i];
+			memcpy(p, &len, sizeof(int));
+			p += sizeof(int);
+			*p++ = (uint8_t)!refs[i];
+			if (refs[i]) {
+				memcpy(p, &views[i].ptr, sizeof(const char*));
+				p += sizeof(const char*);
+			}
+			else {
+				memcpy(p, views[i].ptr, views[i].len);
+				p += views[i].len;
+			}
+		}
+		chunk->log_len += size;
+	}
+
+	static int xml__subtree_cmp(const void* a, const void* b)
+	{
+		size_t x = ((const struct xml__subtree*)a)->begin, y = ((const struct xml__subtree*)b)->begin;
+		return x < y ? -1 : x > y;
+	}
+
+	/* Tokenize a chunk speculatively. Every '<' that is followed by a name is tried as the start of an element, the
+	*  document is cut at the end of the chunk so elements that do not fit end with an error. Each element that is
+	*  closed before that, at any depth, is kept. A '<' inside a comment, CDATA or attribute value gives elements
+	*  that the tokenizer never asks for, as it only looks up positions where it is about to read a child tag.
+	*/
+	static void xml__chunk_tokenize(struct xml__parallel* par, struct xml__chunk* chunk, xml_t* wx)
+	{
+		struct xml__frame { size_t begin, log; int flags, spaced, count; };
+		struct xml__frame* frames = NULL;
+		size_t depth = 0, frames_capacity = 0;
+		size_t p = chunk->index * XML_PARALLEL_CHUNK_SIZE;
+		size_t limit = p + XML_PARALLEL_CHUNK_SIZE < par->in_len ? p + XML_PARALLEL_CHUNK_SIZE : par->in_len;
+		chunk->count = 0;
+		chunk->log_len = 0;
+		wx->in_len = limit;
+		while (p < limit) {
+			const uint8_t* lt = (const uint8_t*)memchr(&par->in[p], '<', limit - p);
+			if (lt == NULL || lt + 1 >= &par->in[limit]) break;
+			p = (size_t)(lt - par->in) + 1;
+			if (!(lt[1] > 127 || xml__isalnum(lt[1]) || lt[1] == '_')) continue;
+
+			wx->lc = xml__subtree;
+			wx->in_pos = p + 1;
+			wx->ch = lt[1];
+			wx->sc = 0;
+			wx->level = 0;
+			wx->span = NULL;
+			wx->flags = par->flags;
+			wx->xml_space_count = 0;
+			depth = 0;
+			for (;;) {
+				xml_token_t token = xml_next_token(wx);
+				if (token == XML_END_DOCUMENT || token == XML_ERROR) {
+					p = wx->in_pos;
+					break;
+				}
+				if (token == XML_START_TAG) {
+					frames = (struct xml__frame*)xml__grow(&wx->allocator, frames, &frames_capacity, depth + 1, sizeof(struct xml__frame));
+					frames[depth].begin = (size_t)((const uint8_t*)xml_get_name_view(wx).ptr - par->in) - 1;
+					frames[depth].log = chunk->log_len;
+					frames[depth].flags = wx->flags & 15;
+					frames[depth].spaced = wx->xml_space_count > 0;
+					frames[depth].count = wx->xml_space_count;
+					depth++;
+				}
+				xml__record(chunk, wx, token);
+				if (token == XML_END_TAG) {
+					struct xml__frame* frame = &frames[--depth];
+					size_t end = wx->in_pos;
+					if (wx->lc != xml__t5) {
+						// The end tag is only closed once the padding and '>' have been read
+						while (end - 1 < limit && (par->in[end - 1] == ' ' || par->in[end - 1] == '\n' || par->in[end - 1] == '\r' || par->in[end - 1] == '\t' || par->in[end - 1] == '\f')) end++;
+						end = (end - 1 < limit && par->in[end - 1] == '>') ? end : 0;
+					}
+					if (end != 0 && wx->xml_space_count - frame->count <= 1) {
+						chunk->subtrees = (struct xml__subtree*)xml__grow(&wx->allocator, chunk->subtrees, &chunk->capacity, chunk->count + 1, sizeof(struct xml__subtree));
+						struct xml__subtree subtree = { frame->begin, end, frame->log, chunk->log_len, frame->flags, frame->spaced };
+						chunk->subtrees[chunk->count++] = subtree;
+					}
+				}
+			}
+		}
+		if (frames != NULL) xml__dealloc(&wx->allocator, frames);
+		if (chunk->count > 1) qsort(chunk->subtrees, chunk->count, sizeof(struct xml__subtree), xml__subtree_cmp);
+	}
+
+	static xml__thread_result_t XML__THREAD_CALL xml__parallel_run(void* arg)
+	{
+		struct xml__parallel* par = (struct xml__parallel*)arg;
+		xml_reader_t reader = { NULL, NULL, NULL };
+		xml_t* wx = xml__create(&reader, (const char*)par->in, par->in_len, &par->allocator);
+		xml__mutex_lock(&par->mutex);
+		while (!par->stop) {
+			if (par->next < par->chunks && par->next < par->first + par->window) {
+				struct xml__chunk* chunk = &par->ring[par->next % par->window];
+				chunk->index = par->next++;
+				chunk->state = 1;
+				xml__mutex_unlock(&par->mutex);
+				xml__chunk_tokenize(par, chunk, wx);
+				xml__mutex_lock(&par->mutex);
+				chunk->state = 2;
+				xml__cond_broadcast(&par->cond);
+			}
+			else xml__cond_wait(&par->cond, &par->mutex);
+		}
+		xml__mutex_unlock(&par->mutex);
+		xml_close(wx);
+		return 0;
+	}
+
+	/* Look up an element tokenized ahead at the '<' just read, chunks behind the tokenizer are released. */
+	static int xml__parallel_find(xml_t* xml)
+	{
+		struct xml__parallel* par = xml->parallel;
+		if (par == NULL) return 0;
+		if (!par->started) {
+			par->flags = xml->flags & ((1 << FLAG_TRIM) | (1 << FLAG_COLLAPSE) | (1 << FLAG_LAZY));
+			par->started = 1;
+			for (int i = 0; i < par->threads; i++) xml__thread_create(&par->handles[i], xml__parallel_run, par);
+		}
+		size_t begin = xml->in_pos - 2;
+		size_t index = begin / XML_PARALLEL_CHUNK_SIZE;
+		struct xml__chunk* chunk = &par->ring[index % par->window];
+		xml__mutex_lock(&par->mutex);
+		while (par->first < index) {
+			struct xml__chunk* old = &par->ring[par->first % par->window];
+			while (par->first < par->next && !(old->index == par->first && old->state == 2)) xml__cond_wait(&par->cond, &par->mutex);
+			old->state = 0;
+			par->first++;
+		}
+		if (par->next < par->first) par->next = par->first;
+		xml__cond_broadcast(&par->cond);
+		while (!(chunk->index == index && chunk->state == 2)) xml__cond_wait(&par->cond, &par->mutex);
+		xml__mutex_unlock(&par->mutex);
+
+		size_t lo = 0, hi = chunk->count;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (chunk->subtrees[mid].begin < begin) lo = mid + 1;
+			else hi = mid;
+		}
+		if (lo == chunk->count) return 0;
+		struct xml__subtree* subtree = &chunk->subtrees[lo];
+		if (subtree->begin != begin || subtree->flags != (xml->flags & 15) || subtree->spaced != (xml->xml_space_count > 0)) return 0;
+		xml->replay = &chunk->log[subtree->log_begin];
+		xml->replay_end = &chunk->log[subtree->log_end];
+		xml->replay_exit = subtree->end;
+		xml->replay_sc = xml->sc;
+		return 1;
+	}
+
+	/* Put the strings of the next record on the stack, when the element is done continue after its end tag. */
+	static int xml__replay(xml_t* xml)
+	{
+		xml->sc = xml->replay_sc;
+		if (xml->replay == xml->replay_end) {
+			xml__advance(xml, &xml->in[xml->in_pos], &xml->in[xml->replay_exit]);
+			xml->in_pos = xml->replay_exit;
+			xml->ch = xml->in[xml->in_pos - 1];
+			return 0;
+		}
+		const uint8_t* p = xml->replay;
+		xml->replay_token = *p++;
+		uint8_t count = *p++;
+		size_t pos;
+		memcpy(&pos, p, sizeof(size_t));
+		p += sizeof(size_t);
+		xml__advance(xml, &xml->in[xml->in_pos], &xml->in[pos]);
+		xml->in_pos = pos;
+		xml->ch = xml->in[pos - 1];
+		for (uint8_t i = 0; i < count; i++) {
+			uint8_t postfix = *p++;
+			int len;
+			memcpy(&len, p, sizeof(int));
+			p += sizeof(int);
+			if (*p++) {
+				xml__push_ref(xml, p, len, postfix);
+				p += len;
+			}
+			else {
+				const uint8_t* ptr;
+				memcpy(&ptr, p, sizeof(const uint8_t*));
+				xml__push_ref(xml, ptr, len, postfix);
+				p += sizeof(const uint8_t*);
+			}
+		}
+		xml->replay = p;
+		return 1;
+	}
+
+	static void xml__parallel_close(struct xml__parallel* par)
+	{
+		if (par->started) {
+			xml__mutex_lock(&par->mutex);
+			par->stop = 1;
+			xml__cond_broadcast(&par->cond);
+			xml__mutex_unlock(&par->mutex);
+			for (int i = 0; i < par->threads; i++) xml__thread_join(par->handles[i]);
+		}
+		for (int i = 0; i < par->window; i++) {
+			if (par->ring[i].subtrees != NULL) xml__dealloc(&par->allocator, par->ring[i].subtrees);
+			if (par->ring[i].log != NULL) xml__dealloc(&par->allocator, par->ring[i].log);
+		}
+		xml__mutex_destroy(&par->mutex);
+		xml__cond_destroy(&par->cond);
+		xml__dealloc(&par->allocator, par->ring);
+		xml__dealloc(&par->allocator, par->handles);
+		xml__dealloc(&par->allocator, par);
+	}
+
+	int xml_set_threads(xml_t* xml, int count)
+	{
+		if (!xml->resident || xml->parallel != NULL || xml->lc != xml__start || count < 1) return xml->parallel != NULL;
+		struct xml__parallel* par = (struct xml__parallel*)xml__alloc(&xml->allocator, NULL, sizeof(struct xml__parallel));
+		if (par == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml parallel tokenizer.");
+			exit(-1);
+		}
+		par->allocator = xml->allocator;
+		par->in = xml->in;
+		par->in_len = xml->in_len;
+		par->chunks = (xml->in_len + XML_PARALLEL_CHUNK_SIZE - 1) / XML_PARALLEL_CHUNK_SIZE;
+		par->first = par->next = 0;
+		par->threads = count;
+		par->window = count * 2;
+		par->flags = 0;
+		par->started = par->stop = 0;
+		par->ring = (struct xml__chunk*)xml__alloc(&xml->allocator, NULL, par->window * sizeof(struct xml__chunk));
+		par->handles = (xml__thread_t*)xml__alloc(&xml->allocator, NULL, count * sizeof(xml__thread_t));
+		if (par->ring == NULL || par->handles == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml parallel tokenizer.");
+			exit(-1);
+		}
+		memset(par->ring, 0, par->window * sizeof(struct xml__chunk));
+		xml__mutex_init(&par->mutex);
+		xml__cond_init(&par->cond);
+		xml->parallel = par;
+		return 1;
+	}
+
+	/* Blocks of the input read on a thread ahead of the tokenizer. The thread fills the block after the one that
+	*  the tokenizer reads, and the tokenizer takes the filled block in place of its own buffer, so nothing is copied.
+	*/
+	struct xml__ahead {
+		xml_allocator_t allocator;
+		xml_reader_t reader;
+		uint8_t* blocks[2];
+		size_t lengths[2];
+		int codes[2];
+		size_t filled, taken;
+		int stop;
+		xml__thread_t handle;
+		xml__mutex_t mutex;
+		xml__cond_t cond;
+	};
+
+	static xml__thread_result_t XML__THREAD_CALL xml__ahead_run(void* arg)
+	{
+		struct xml__ahead* ahead = (struct xml__ahead*)arg;
+		xml__mutex_lock(&ahead->mutex);
+		while (!ahead->stop) {
+			// The block before the one taken last is still read by the tokenizer
+			if (ahead->filled < ahead->taken + 1) {
+				size_t i = ahead->filled % 2, length = 0;
+				xml__mutex_unlock(&ahead->mutex);
+				int code = ahead->reader.read(ahead->reader.context, ahead->blocks[i], XML_READ_AHEAD_SIZE, &length);
+				xml__mutex_lock(&ahead->mutex);
+				ahead->lengths[i] = length;
+				ahead->codes[i] = code;
+				ahead->filled++;
+				xml__cond_broadcast(&ahead->cond);
+				if (code != 0 || length == 0) break;
+			}
+			else xml__cond_wait(&ahead->cond, &ahead->mutex);
+		}
+		xml__mutex_unlock(&ahead->mutex);
+		return 0;
+	}
+
+	static int xml__ahead_read(xml_t* xml, size_t* length)
+	{
+		struct xml__ahead* ahead = xml->ahead;
+		xml__mutex_lock(&ahead->mutex);
+		while (ahead->filled == ahead->taken) xml__cond_wait(&ahead->cond, &ahead->mutex);
+		size_t i = ahead->taken % 2;
+		int code = ahead->codes[i];
+		*length = ahead->lengths[i];
+		// The end of the input stays in the block, so that it is read again if the tokenizer asks once more
+		if (code == 0 && *length > 0) ahead->taken++;
+		xml__cond_broadcast(&ahead->cond);
+		xml__mutex_unlock(&ahead->mutex);
+		xml->in = ahead->blocks[i];
+		return code;
+	}
+
+	static void xml__ahead_close(xml_t* xml)
+	{
+		struct xml__ahead* ahead = xml->ahead;
+		xml__mutex_lock(&ahead->mutex);
+		ahead->stop = 1;
+		xml__cond_broadcast(&ahead->cond);
+		xml__mutex_unlock(&ahead->mutex);
+		xml__thread_join(ahead->handle);
+		xml__mutex_destroy(&ahead->mutex);
+		xml__cond_destroy(&ahead->cond);
+		xml__dealloc(&ahead->allocator, ahead->blocks[0]);
+		xml__dealloc(&ahead->allocator, ahead->blocks[1]);
+		xml__dealloc(&ahead->allocator, ahead);
+		xml->ahead = NULL;
+		xml->in = xml->buffer;
+		xml->in_pos = xml->in_len = 0;
+	}
+
+	int xml_set_read_ahead(xml_t* xml, int enable)
+	{
+		if (xml->lc != xml__start || xml->in_len > 0) return xml->ahead != NULL;
+		if (enable <= 0) {
+			if (xml->ahead != NULL) xml__ahead_close(xml);
+			return 0;
+		}
+		if (xml->ahead != NULL || xml->resident || xml->push || xml->reader.read == NULL) return xml->ahead != NULL;
+		struct xml__ahead* ahead = (struct xml__ahead*)xml__alloc(&xml->allocator, NULL, sizeof(struct xml__ahead));
+		if (ahead == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml read ahead.");
+			exit(-1);
+		}
+		ahead->allocator = xml->allocator;
+		ahead->reader = xml->reader;
+		ahead->blocks[0] = (uint8_t*)xml__alloc(&xml->allocator, NULL, XML_READ_AHEAD_SIZE);
+		ahead->blocks[1] = (uint8_t*)xml__alloc(&xml->allocator, NULL, XML_READ_AHEAD_SIZE);
+		if (ahead->blocks[0] == NULL || ahead->blocks[1] == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml read ahead.");
+			exit(-1);
+		}
+		ahead->filled = ahead->taken = 0;
+		ahead->stop = 0;
+		xml__mutex_init(&ahead->mutex);
+		xml__cond_init(&ahead->cond);
+		xml->ahead = ahead;
+		xml__thread_create(&ahead->handle, xml__ahead_run, ahead);
+		return 1;
 	}
-	return XML_ERROR;
+#else
+	static int xml__parallel_find(xml_t* xml)
+	{
+		(void)xml;
+		return 0;
 	}
 
-	const char* xml_get_error(xml_t* xml) {
-		if (xml->stack[xml->sc - sizeof(uint8_t)] == 'e') {
-			int cnt = *(int*)xml__peek(xml, sizeof(int), sizeof(uint8_t));
-			return (const char*)&xml->stack[(size_t)xml->sc - cnt - sizeof(int) - sizeof(uint8_t)];
-		}
-		return NULL;
+	static int xml__replay(xml_t* xml)
+	{
+		(void)xml;
+		return 0;
 	}
 
-	const char* xml_get_name(xml_t* xml) {
-		if (xml->stack[xml->sc - sizeof(uint8_t)] == 'n') {
-			uint32_t cnt = *(int*)xml__peek(xml, sizeof(int), sizeof(uint8_t));
-			return (const char*)&xml->stack[(size_t)xml->sc - cnt - sizeof(int) - sizeof(uint8_t)];
-		}
-		else if (xml->stack[xml->sc - sizeof(uint8_t)] == 'v') {
-			uint32_t cnt = *((int*)xml__peek(xml, sizeof(int), sizeof(uint8_t)));
-			cnt += *((int*)xml__peek(xml, sizeof(int), cnt + sizeof(int) + 2 * sizeof(uint8_t)));
-			return (const char*)&xml->stack[(size_t)xml->sc - cnt - 2 * sizeof(int) - 2 * sizeof(uint8_t)];
+	int xml_set_threads(xml_t* xml, int count)
+	{
+		(void)xml;
+		(void)count;
+		return 0;
+	}
+
+	static int xml__ahead_read(xml_t* xml, size_t* length)
+	{
+		(void)xml;
+		*length = 0;
+		return 0;
+	}
+
+	int xml_set_read_ahead(xml_t* xml, int enable)
+	{
+		(void)xml;
+		(void)enable;
+		return 0;
+	}
+#endif
+
+	/* Strings that are not views into a resident document only live until the next token, copy them to the strings of the batch. */
+	static xml_strview_t xml__batch_view(xml_t* xml, xml_strview_t view)
+	{
+		if (view.ptr == NULL) return view;
+		if (xml->resident && (const uint8_t*)view.ptr >= xml->in && (const uint8_t*)view.ptr < xml->in + xml->in_len) return view;
+		if (xml->strings_len + view.len > xml->strings_capacity) {
+			size_t new_capacity = xml->strings_capacity > 0 ? xml->strings_capacity * 2 : STACK_SIZE;
+			while (xml->strings_len + view.len > new_capacity) new_capacity *= 2;
+			uint8_t* strings = (uint8_t*)xml__alloc(&xml->allocator, xml->strings, new_capacity);
+			if (strings == NULL) {
+				fprintf(stderr, "PANIC: Failed to allocate memory for xml token strings.");
+				exit(-1);
+			}
+			// Move the views of the records in this batch along with the strings
+			for (size_t i = 0; i < xml->batch_count && strings != xml->strings; i++) {
+				xml_strview_t* views[3] = { &xml->batch[i].name, &xml->batch[i].value, &xml->batch[i].text };
+				for (int j = 0; j < 3; j++) {
+					const uint8_t* ptr = (const uint8_t*)views[j]->ptr;
+					if (ptr != NULL && ptr >= xml->strings && ptr < xml->strings + xml->strings_len) views[j]->ptr = (const char*)(strings + (ptr - xml->strings));
+				}
+			}
+			xml->strings = strings;
+			xml->strings_capacity = new_capacity;
 		}
-		return NULL;
+		memcpy(&xml->strings[xml->strings_len], view.ptr, view.len);
+		view.ptr = (const char*)&xml->strings[xml->strings_len];
+		xml->strings_len += view.len;
+		return view;
 	}
 
-	const char* xml_get_value(xml_t* xml) {
-		if (xml->stack[xml->sc - sizeof(uint8_t)] == 'v') {
-			uint32_t cnt = *(int*)xml__peek(xml, sizeof(int), sizeof(uint8_t));
-			return (const char*)&xml->stack[(size_t)xml->sc - cnt - sizeof(int) - sizeof(uint8_t)];
+	/* Add a token to the batch, returns non-zero when the tokenizer shall return. */
+	static int xml__batch_add(xml_t* xml, xml_token_t token)
+	{
+		xml_token_rec_t* rec = &xml->batch[xml->batch_count++];
+		int ref;
+		rec->token = token;
+		rec->depth = xml->level;
+		rec->name.ptr = rec->value.ptr = rec->text.ptr = NULL;
+		rec->name.len = rec->value.len = rec->text.len = 0;
+		rec->refs = 0;
+		if (token == XML_ERROR) {
+			const char* error = xml_get_error(xml);
+			rec->text.ptr = error;
+			rec->text.len = error != NULL ? xml__strlen(error) : 0;
+			rec->text = xml__batch_view(xml, rec->text);
 		}
-		return NULL;
+		else if (token == XML_TEXT) {
+			rec->text = xml__batch_view(xml, xml__get_view(xml, 't', &ref));
+			rec->refs = xml__get_refs(xml, 't');
+		}
+		else if (token == XML_ATTRIBUTE || token == XML_DECLARATION) {
+			size_t top = xml->sc - xml__peek_view(xml, xml->sc, &rec->value);
+			xml__peek_view(xml, top, &rec->name);
+			rec->name = xml__batch_view(xml, rec->name);
+			rec->value = xml__batch_view(xml, rec->value);
+			rec->refs = xml__get_refs(xml, 'v');
+		}
+		else if (token != XML_START_DOCUMENT && token != XML_END_DOCUMENT) {
+			xml__peek_view(xml, xml->sc, &rec->name);
+			rec->name = xml__batch_view(xml, rec->name);
+		}
+		return xml->batch_count == xml->batch_max || token == XML_END_DOCUMENT || token == XML_ERROR;
 	}
 
-	const char* xml_get_text(xml_t* xml)
+	size_t xml_next_tokens(xml_t* xml, xml_token_rec_t* out, size_t max)
 	{
-		if (xml->stack[xml->sc - sizeof(uint8_t)] == 't') {
-			uint32_t cnt = *(int*)xml__peek(xml, sizeof(int), sizeof(uint8_t));
-			return (const char*)&xml->stack[(size_t)xml->sc - cnt - sizeof(int) - sizeof(uint8_t)];
+		if (max == 0) return 0;
+		xml->batch = out;
+		xml->batch_count = 0;
+		xml->batch_max = max;
+		xml->strings_len = 0;
+		if (xml_next_token(xml) == XML_NEED_MORE) {
+			xml_token_rec_t* rec = &xml->batch[xml->batch_count++];
+			memset(rec, 0, sizeof(xml_token_rec_t));
+			rec->token = XML_NEED_MORE;
+			rec->depth = xml->level;
 		}
-		return NULL;
+		xml->batch = NULL;
+		return xml->batch_count;
 	}
 
 	int xml_get_trim(xml_t* xml)
@@ -890,11 +3485,641 @@ extern "C" {
 		}
 	}
 
+	int xml_get_lazy(xml_t* xml)
+	{
+		return (xml->flags & (1 << FLAG_LAZY)) > 0;
+	}
+
+	void xml_set_lazy(xml_t* xml, int enable)
+	{
+		if (enable > 0) {
+			xml->flags |= 1 << FLAG_LAZY;
+		}
+		else {
+			xml->flags &= ~(1 << FLAG_LAZY);
+		}
+	}
+
+	int xml_get_stats(xml_t* xml, xml_stats_t* stats)
+	{
+#ifdef XML_STATS
+		*stats = xml->stats;
+		stats->bytes = xml->in_base + xml->in_pos;
+		return 1;
+#else
+		(void)xml;
+		memset(stats, 0, sizeof(xml_stats_t));
+		return 0;
+#endif
+	}
+
+	static void xml__reset(xml_t* xml, const xml_reader_t* reader, const char* data, size_t size)
+	{
+#ifdef XML_PARALLEL
+		if (xml->parallel != NULL) xml__parallel_close(xml->parallel);
+		xml->parallel = NULL;
+		if (xml->ahead != NULL) xml__ahead_close(xml);
+#endif
+		if (xml->reader.close != NULL) xml->reader.close(xml->reader.context);
+		xml__init(xml, reader, data, size);
+	}
+
+	int xml_reset(xml_t* xml, const xml_reader_t* reader)
+	{
+		xml_reader_t none = { NULL, NULL, NULL };
+		if (reader != NULL) xml->push = 0;
+		xml__reset(xml, reader != NULL ? reader : &none, NULL, 0);
+		return 1;
+	}
+
+	int xml_reset_file(xml_t* xml, const char* filename)
+	{
+		xml_reader_t reader;
+
+		if (!xml__open_file(&reader, filename, XML_COMPRESSION_AUTO, &xml->allocator)) {
+			xml_reset(xml, NULL);
+			return 0;
+		}
+
+		return xml_reset(xml, &reader);
+	}
+
+	int xml_reset_memory(xml_t* xml, const char* data, size_t size)
+	{
+		xml_reader_t none = { NULL, NULL, NULL };
+		xml->push = 0;
+		xml__reset(xml, &none, data, size);
+		return 1;
+	}
+
+	/* A token cache starts with this header, then come the tokens, the offsets of the strings and the strings. The
+	*  numbers are in the byte order of the machine that wrote the cache, byte_order tells which. A token is a byte and
+	*  then the ids of its strings as varints: the name for tags and attribute tokens, name and value for
+	*  XML_ATTRIBUTE and XML_DECLARATION and the text for XML_TEXT. The string of an id runs from its offset up to the
+	*  next one, the offsets are 64-bit and there is one more than there are strings.
+	*/
+	struct xml__tokens_header {
+		char magic[8];
+		uint32_t version, flags;
+		uint64_t byte_order, source_size, source_checksum;
+		uint64_t token_count, tokens_offset, tokens_size, string_count, offsets_offset, strings_offset, file_size;
+	};
+
+	static const char xml__tokens_magic[8] = { 'x', 'm', 'l', 't', 'o', 'k', '\r', '\n' };
+	static const uint32_t xml__tokens_version = 1;
+	static const uint64_t xml__tokens_byte_order = 0x0102030405060708ull;
+	static const char xml__error_tokens[] = "Error: The token cache is corrupt.";
+
+	static int xml__tokens_count(int token)
+	{
+		if (token == XML_ATTRIBUTE || token == XML_DECLARATION) return 2;
+		return token == XML_START_DOCUMENT || token == XML_END_DOCUMENT ? 0 : 1;
+	}
+
+	static uint64_t xml__checksum(uint64_t hash, const uint8_t* p, size_t n)
+	{
+		for (; n >= 8; p += 8, n -= 8) {
+			uint64_t word;
+			memcpy(&word, p, 8);
+			hash = (hash ^ word) * 0x100000001b3ull;
+			hash ^= hash >> 32;
+		}
+		for (; n > 0; p++, n--) hash = (hash ^ *p) * 0x100000001b3ull;
+		return hash;
+	}
+
+	/* The words are taken from the start of the file whatever the size of the blocks that are read. */
+	static int xml__checksum_file(const char* filename, uint64_t* size, uint64_t* checksum)
+	{
+		FILE* fp;
+		uint8_t block[16384];
+		size_t length, carry = 0;
+		if (XML_FOPEN(fp, filename, "rb") != 0) return 0;
+		*size = 0;
+		*checksum = 0xcbf29ce484222325ull;
+		for (;;) {
+			if (XML_FREAD(fp, block + carry, sizeof(block) - carry, length) != 0) {
+				XML_FCLOSE(fp);
+				return 0;
+			}
+			if (length == 0) break;
+			*size += length;
+			length += carry;
+			carry = length % 8;
+			*checksum = xml__checksum(*checksum, block, length - carry);
+			memmove(block, block + length - carry, carry);
+		}
+		*checksum = xml__checksum(*checksum, block, carry);
+		XML_FCLOSE(fp);
+		return 1;
+	}
+
+	/* Strings are interned in a table of open addressing that is kept at most half full. */
+	struct xml__tokens_writer {
+		xml_allocator_t allocator;
+		FILE* fp;
+		uint64_t pos, count;
+		uint8_t out[XML_BUFFER_SIZE < 64 ? 64 : XML_BUFFER_SIZE];
+		size_t out_len;
+		uint8_t* strings;
+		uint64_t* offsets;
+		uint32_t* slots;
+		size_t strings_len, strings_capacity, offsets_capacity, slots_capacity;
+	};
+
+	static void* xml__tokens_grow(struct xml__tokens_writer* w, void* ptr, size_t* capacity, size_t size, size_t item)
+	{
+		if (size <= *capacity) return ptr;
+		size_t new_capacity = *capacity > 0 ? *capacity : 1024;
+		while (size > new_capacity) new_capacity *= 2;
+		ptr = xml__alloc(&w->allocator, ptr, new_capacity * item);
+		if (ptr == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml token cache.");
+			exit(-1);
+		}
+		*capacity = new_capacity;
+		return ptr;
+	}
+
+	static int xml__tokens_write(struct xml__tokens_writer* w, const void* data, size_t size)
+	{
+		w->pos += size;
+		return fwrite(data, 1, size, w->fp) == size;
+	}
+
+	static int xml__tokens_flush(struct xml__tokens_writer* w)
+	{
+		int ok = xml__tokens_write(w, w->out, w->out_len);
+		w->out_len = 0;
+		return ok;
+	}
+
+	static uint32_t xml__tokens_intern(struct xml__tokens_writer* w, xml_strview_t str)
+	{
+		const uint8_t* ptr = str.ptr != NULL ? (const uint8_t*)str.ptr : (const uint8_t*)"";
+		uint32_t id, count = (uint32_t)w->count;
+		if ((size_t)(count + 1) * 2 > w->slots_capacity) {
+			size_t capacity = w->slots_capacity > 0 ? w->slots_capacity * 2 : 1024;
+			uint32_t* slots = (uint32_t*)xml__alloc(&w->allocator, NULL, capacity * sizeof(uint32_t));
+			if (slots == NULL) {
+				fprintf(stderr, "PANIC: Failed to allocate memory for xml token cache.");
+				exit(-1);
+			}
+			memset(slots, 0, capacity * sizeof(uint32_t));
+			for (id = 0; id < count; id++) {
+				uint64_t hash = xml__checksum(0xcbf29ce484222325ull, &w->strings[w->offsets[id]], (size_t)(w->offsets[id + 1] - w->offsets[id]));
+				size_t i = (size_t)hash & (capacity - 1);
+				while (slots[i] != 0) i = (i + 1) & (capacity - 1);
+				slots[i] = id + 1;
+			}
+			if (w->slots != NULL) xml__dealloc(&w->allocator, w->slots);
+			w->slots = slots;
+			w->slots_capacity = capacity;
+		}
+		uint64_t hash = xml__checksum(0xcbf29ce484222325ull, ptr, str.len);
+		size_t i = (size_t)hash & (w->slots_capacity - 1);
+		for (; w->slots[i] != 0; i = (i + 1) & (w->slots_capacity - 1)) {
+			id = w->slots[i] - 1;
+			if (w->offsets[id + 1] - w->offsets[id] == str.len && memcmp(&w->strings[w->offsets[id]], ptr, str.len) == 0) return id;
+		}
+		w->strings = (uint8_t*)xml__tokens_grow(w, w->strings, &w->strings_capacity, w->strings_len + str.len, sizeof(uint8_t));
+		w->offsets = (uint64_t*)xml__tokens_grow(w, w->offsets, &w->offsets_capacity, (size_t)count + 2, sizeof(uint64_t));
+		memcpy(&w->strings[w->strings_len], ptr, str.len);
+		w->strings_len += str.len;
+		w->offsets[0] = 0;
+		w->offsets[count + 1] = w->strings_len;
+		w->slots[i] = count + 1;
+		w->count++;
+		return count;
+	}
+
+	/* A string as the accessors return it, references that lazy mode left in are decoded. */
+	static xml_strview_t xml__tokens_string(xml_t* xml, uint8_t kind, int slot)
+	{
+		int ref;
+		xml_strview_t view = xml__get_view(xml, kind, &ref);
+		if (xml__get_refs(xml, kind)) {
+			view.ptr = xml__get_cstr(xml, kind, slot, &view.len);
+		}
+		return view;
+	}
+
+	int xml_write_tokens(xml_t* xml, const char* source, const char* filename)
+	{
+		struct xml__tokens_header header;
+		struct xml__tokens_writer* w;
+		memset(&header, 0, sizeof(header));
+		if (!xml__checksum_file(source, &header.source_size, &header.source_checksum)) return 0;
+
+		w = (struct xml__tokens_writer*)xml__alloc(&xml->allocator, NULL, sizeof(struct xml__tokens_writer));
+		if (w == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml token cache.");
+			exit(-1);
+		}
+		memset(w, 0, sizeof(struct xml__tokens_writer));
+		w->allocator = xml->allocator;
+		if (XML_FOPEN(w->fp, filename, "wb") != 0) {
+			xml__dealloc(&xml->allocator, w);
+			return 0;
+		}
+
+		int ok = xml__tokens_write(w, &header, sizeof(header));
+		xml_token_t token;
+		do {
+			token = xml_next_token(xml);
+			if (token == XML_ERROR || token == XML_NEED_MORE || w->count >= 0xfffffffeu) {
+				ok = 0;
+				break;
+			}
+			if (w->out_len + 1 + 2 * 5 > sizeof(w->out)) ok &= xml__tokens_flush(w);
+			w->out[w->out_len++] = (uint8_t)token;
+			for (int i = 0; i < xml__tokens_count(token); i++) {
+				uint8_t kind = token == XML_TEXT ? 't' : i == 0 ? 'n' : 'v';
+				uint32_t id = xml__tokens_intern(w, xml__tokens_string(xml, kind, i));
+				for (; id >= 0x80; id >>= 7) w->out[w->out_len++] = (uint8_t)(id | 0x80);
+				w->out[w->out_len++] = (uint8_t)id;
+			}
+			header.token_count++;
+		} while (token != XML_END_DOCUMENT);
+
+		if (ok) {
+			static const uint8_t zeros[8] = { 0 };
+			uint64_t empty = 0;
+			ok &= xml__tokens_flush(w);
+			header.tokens_offset = sizeof(header);
+			header.tokens_size = w->pos - sizeof(header);
+			ok &= xml__tokens_write(w, zeros, (size_t)((8 - w->pos % 8) % 8));
+			header.offsets_offset = w->pos;
+			header.string_count = w->count;
+			ok &= w->count > 0 ? xml__tokens_write(w, w->offsets, (size_t)(w->count + 1) * sizeof(uint64_t)) : xml__tokens_write(w, &empty, sizeof(uint64_t));
+			header.strings_offset = w->pos;
+			ok &= xml__tokens_write(w, w->strings, w->strings_len);
+			header.file_size = w->pos;
+			memcpy(header.magic, xml__tokens_magic, sizeof(header.magic));
+			header.version = xml__tokens_version;
+			header.flags = (uint32_t)(xml->flags & ((1 << FLAG_TRIM) | (1 << FLAG_COLLAPSE)));
+			header.byte_order = xml__tokens_byte_order;
+			// The header is written last, a cache that was cut short has no magic
+			ok &= fflush(w->fp) == 0 && fseek(w->fp, 0, SEEK_SET) == 0 && fwrite(&header, 1, sizeof(header), w->fp) == sizeof(header);
+			ok &= fflush(w->fp) == 0;
+		}
+		XML_FCLOSE(w->fp);
+		if (w->strings != NULL) xml__dealloc(&xml->allocator, w->strings);
+		if (w->offsets != NULL) xml__dealloc(&xml->allocator, w->offsets);
+		if (w->slots != NULL) xml__dealloc(&xml->allocator, w->slots);
+		xml__dealloc(&xml->allocator, w);
+		if (!ok) remove(filename);
+		return ok;
+	}
+
+	static int xml__tokens_varint(xml_t* xml, uint64_t* id)
+	{
+		*id = 0;
+		for (int shift = 0; xml->replay < xml->replay_end && shift < 35; shift += 7) {
+			uint8_t b = *xml->replay++;
+			*id |= (uint64_t)(b & 0x7f) << shift;
+			if (b < 0x80) return 1;
+		}
+		return 0;
+	}
+
+	/* The cursor is in replay, and the token that was returned last is in replay_token. */
+	static void xml__tokens_next(xml_t* xml)
+	{
+		if (xml->replay_token == XML_ERROR) return;
+		if (xml->replay_token == XML_END_TAG) xml->level--;
+		xml->sc = 0;
+		if (xml->replay == xml->replay_end) {
+			xml->replay_token = XML_END_DOCUMENT;
+			return;
+		}
+		int token = *xml->replay++;
+		int count = xml__tokens_count(token);
+		for (int i = 0; i < count && token < XML_ERROR; i++) {
+			uint64_t id, offset, end;
+			if (!xml__tokens_varint(xml, &id) || id >= xml->tokens_string_count) {
+				token = XML_NEED_MORE;
+				break;
+			}
+			memcpy(&offset, xml->tokens_offsets + id * sizeof(uint64_t), sizeof(uint64_t));
+			memcpy(&end, xml->tokens_offsets + (id + 1) * sizeof(uint64_t), sizeof(uint64_t));
+			if (offset > end || end > xml->tokens_strings_size || end - offset > 0x7fffffff) {
+				token = XML_NEED_MORE;
+				break;
+			}
+			xml__push_ref(xml, xml->tokens_strings + offset, (int)(end - offset), token == XML_TEXT ? 'T' : i == 0 ? 'N' : 'V');
+		}
+		if (token >= XML_ERROR) {
+			int len = (int)sizeof(xml__error_tokens);
+			uint8_t prefix = 'e';
+			xml->sc = 0;
+			xml__push(xml, xml__error_tokens, sizeof(xml__error_tokens));
+			xml__push(xml, &len, sizeof(int));
+			xml__push(xml, &prefix, sizeof(uint8_t));
+			token = XML_ERROR;
+		}
+		if (token == XML_START_TAG) xml->level++;
+		xml->replay_token = token;
+	}
+
+	/* Tokens are read without pushing their strings up to the end tag of the element, which is returned next. */
+	static int xml__tokens_skip(xml_t* xml)
+	{
+		int token = xml->replay_token, depth = 1;
+		if (token != XML_START_TAG && token != XML_START_ATTRIBUTES && token != XML_ATTRIBUTE && token != XML_END_ATTRIBUTES) return 0;
+		for (const uint8_t* p = xml->replay; p < xml->replay_end;) {
+			const uint8_t* record = p;
+			token = *p++;
+			for (int i = 0; i < xml__tokens_count(token); i++) {
+				while (p < xml->replay_end && *p >= 0x80) p++;
+				p++;
+			}
+			if (token == XML_START_TAG) depth++;
+			else if (token == XML_END_TAG && --depth == 0) {
+				xml->replay = record;
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+#ifndef XML_NO_MMAP
+	xml_t* xml_open_tokens(const char* filename, const char* source)
+	{
+		struct xml__tokens_header header;
+		struct xml__mapping* mapping = xml__map_file(filename);
+		if (mapping == NULL) return NULL;
+		if (mapping->size < sizeof(header)) {
+			xml__mapping_close(mapping);
+			return NULL;
+		}
+		memcpy(&header, mapping->data, sizeof(header));
+		if (memcmp(header.magic, xml__tokens_magic, sizeof(header.magic)) != 0 || header.version != xml__tokens_version
+			|| header.byte_order != xml__tokens_byte_order || header.file_size != mapping->size
+			|| header.tokens_offset < sizeof(header) || header.tokens_offset + header.tokens_size > header.offsets_offset
+			|| header.offsets_offset > header.strings_offset
+			|| header.strings_offset - header.offsets_offset != (header.string_count + 1) * sizeof(uint64_t)
+			|| header.strings_offset > header.file_size) {
+			xml__mapping_close(mapping);
+			return NULL;
+		}
+		if (source != NULL) {
+			uint64_t size, checksum;
+			if (!xml__checksum_file(source, &size, &checksum) || size != header.source_size || checksum != header.source_checksum) {
+				xml__mapping_close(mapping);
+				return NULL;
+			}
+		}
+
+		const uint8_t* data = (const uint8_t*)mapping->data;
+		xml_reader_t reader = { mapping, NULL, xml__mapping_close };
+		xml_t* xml = xml__create(&reader, "", 0, &xml__default_allocator);
+		xml->lc = xml__tokens;
+		xml->flags = (int)header.flags;
+		xml->replay = data + header.tokens_offset;
+		xml->replay_end = data + header.tokens_offset + header.tokens_size;
+		xml->replay_token = XML_START_DOCUMENT;
+		xml->tokens_offsets = data + header.offsets_offset;
+		xml->tokens_strings = data + header.strings_offset;
+		xml->tokens_string_count = header.string_count;
+		xml->tokens_strings_size = header.file_size - header.strings_offset;
+		return xml;
+	}
+#endif
+
 	void xml_close(xml_t* xml)
 	{
-		XML_FCLOSE(xml->fp);
-		XML_FREE(NULL, xml->stack);
-		XML_FREE(NULL, xml);
+#ifdef XML_PARALLEL
+		if (xml->parallel != NULL) xml__parallel_close(xml->parallel);
+		if (xml->ahead != NULL) xml__ahead_close(xml);
+#endif
+		if (xml->reader.close != NULL) xml->reader.close(xml->reader.context);
+		if (xml->buffer != NULL) xml__dealloc(&xml->allocator, xml->buffer);
+		if (xml->save_stack != NULL) xml__dealloc(&xml->allocator, xml->save_stack);
+		if (xml->cstr[0] != NULL) xml__dealloc(&xml->allocator, xml->cstr[0]);
+		if (xml->cstr[1] != NULL) xml__dealloc(&xml->allocator, xml->cstr[1]);
+		if (xml->strings != NULL) xml__dealloc(&xml->allocator, xml->strings);
+		if (xml->own_symbols != NULL) xml_symbols_free(xml->own_symbols);
+		if (xml->filter != NULL) xml_set_filter(xml, NULL, 0);
+		xml__dealloc(&xml->allocator, xml->stack);
+		xml__dealloc(&xml->allocator, xml);
+	}
+
+	/* Blocks in the arena have their size in a header in front of them, aligned for any type. */
+#define XML__ARENA_ALIGN (16)
+
+	static void* xml__arena_reallocate(void* context, void* ptr, size_t size)
+	{
+		xml_arena_t* arena = (xml_arena_t*)context;
+		uint8_t* p = (uint8_t*)ptr;
+		size_t old = 0;
+		if (p != NULL && (p < arena->buffer || p >= arena->buffer + arena->size)) return XML_REALLOC(NULL, ptr, size);
+		if (p != NULL) memcpy(&old, p - XML__ARENA_ALIGN, sizeof(size_t));
+		size = (size + XML__ARENA_ALIGN - 1) & ~(size_t)(XML__ARENA_ALIGN - 1);
+		if (p != NULL && p == arena->buffer + arena->last && arena->last + size <= arena->size) {
+			// The last block grows or shrinks in place
+			memcpy(p - XML__ARENA_ALIGN, &size, sizeof(size_t));
+			arena->used = arena->last + size;
+			return p;
+		}
+		uint8_t* block;
+		if (arena->used + XML__ARENA_ALIGN + size <= arena->size) {
+			arena->last = arena->used + XML__ARENA_ALIGN;
+			arena->used = arena->last + size;
+			block = arena->buffer + arena->last;
+			memcpy(block - XML__ARENA_ALIGN, &size, sizeof(size_t));
+		}
+		else {
+			block = (uint8_t*)XML_REALLOC(NULL, NULL, size);
+			if (block == NULL) return NULL;
+		}
+		if (p != NULL) memcpy(block, p, old < size ? old : size);
+		return block;
+	}
+
+	static void xml__arena_deallocate(void* context, void* ptr)
+	{
+		xml_arena_t* arena = (xml_arena_t*)context;
+		uint8_t* p = (uint8_t*)ptr;
+		if (p < arena->buffer || p >= arena->buffer + arena->size) XML_FREE(NULL, ptr);
+		else if (p == arena->buffer + arena->last) {
+			arena->used = arena->last - XML__ARENA_ALIGN;
+			arena->last = arena->size;
+		}
+	}
+
+	void xml_arena_init(xml_arena_t* arena, void* buffer, size_t size)
+	{
+		size_t skip = (XML__ARENA_ALIGN - (size_t)((uintptr_t)buffer % XML__ARENA_ALIGN)) % XML__ARENA_ALIGN;
+		arena->buffer = (uint8_t*)buffer + (skip < size ? skip : size);
+		arena->size = skip < size ? size - skip : 0;
+		xml_arena_reset(arena);
+	}
+
+	xml_allocator_t xml_arena_allocator(xml_arena_t* arena)
+	{
+		xml_allocator_t allocator = { arena, xml__arena_reallocate, xml__arena_deallocate };
+		return allocator;
+	}
+
+	void xml_arena_reset(xml_arena_t* arena)
+	{
+		arena->used = 0;
+		arena->last = arena->size;
+	}
+
+#undef XML__ARENA_ALIGN
+
+	/* Names are kept nul-terminated in one block, and found by an open addressed hash table of ids. */
+	struct xml__symbol {
+		size_t offset, len;
+	};
+
+	struct xml__symbols {
+		xml_allocator_t allocator;
+		int* slots;
+		uint32_t* hashes;
+		struct xml__symbol* symbols;
+		char* names;
+		size_t slot_capacity, count, capacity, names_len, names_capacity;
+	};
+
+	static uint32_t xml__symbols_hash(const char* name, size_t len)
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < len; i++) hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+		return hash;
+	}
+
+	static void* xml__symbols_grow(xml_symbols_t* symbols, void* ptr, size_t size)
+	{
+		void* ret = xml__alloc(&symbols->allocator, ptr, size);
+		if (ret == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml symbols.");
+			exit(-1);
+		}
+		return ret;
+	}
+
+	static void xml__symbols_rehash(xml_symbols_t* symbols, size_t slot_capacity)
+	{
+		if (symbols->slots != NULL) xml__dealloc(&symbols->allocator, symbols->slots);
+		symbols->slots = (int*)xml__symbols_grow(symbols, NULL, slot_capacity * sizeof(int));
+		symbols->slot_capacity = slot_capacity;
+		memset(symbols->slots, 0, slot_capacity * sizeof(int));
+
+		for (size_t id = 1; id <= symbols->count; id++) {
+			size_t i = symbols->hashes[id - 1] & (slot_capacity - 1);
+			while (symbols->slots[i] != 0) i = (i + 1) & (slot_capacity - 1);
+			symbols->slots[i] = (int)id;
+		}
+	}
+
+	static int xml__symbols_intern(xml_symbols_t* symbols, const char* name, size_t len, int add)
+	{
+		uint32_t hash = xml__symbols_hash(name, len);
+		size_t mask = symbols->slot_capacity - 1, i = hash & mask;
+
+		for (int id; (id = symbols->slots[i]) != 0; i = (i + 1) & mask) {
+			const struct xml__symbol* symbol = &symbols->symbols[id - 1];
+			if (symbols->hashes[id - 1] == hash && symbol->len == len && memcmp(&symbols->names[symbol->offset], name, len) == 0) return id;
+		}
+		if (!add) return 0;
+
+		if (symbols->count == symbols->capacity) {
+			symbols->capacity *= 2;
+			symbols->symbols = (struct xml__symbol*)xml__symbols_grow(symbols, symbols->symbols, symbols->capacity * sizeof(struct xml__symbol));
+			symbols->hashes = (uint32_t*)xml__symbols_grow(symbols, symbols->hashes, symbols->capacity * sizeof(uint32_t));
+		}
+		if (symbols->names_len + len + 1 > symbols->names_capacity) {
+			while (symbols->names_len + len + 1 > symbols->names_capacity) symbols->names_capacity *= 2;
+			symbols->names = (char*)xml__symbols_grow(symbols, symbols->names, symbols->names_capacity);
+		}
+
+		struct xml__symbol* symbol = &symbols->symbols[symbols->count];
+		symbol->offset = symbols->names_len;
+		symbol->len = len;
+		memcpy(&symbols->names[symbols->names_len], name, len);
+		symbols->names[symbols->names_len + len] = '\0';
+		symbols->names_len += len + 1;
+		symbols->hashes[symbols->count] = hash;
+		symbols->slots[i] = (int)++symbols->count;
+
+		if (symbols->count * 2 > symbols->slot_capacity) xml__symbols_rehash(symbols, symbols->slot_capacity * 2);
+		return (int)symbols->count;
+	}
+
+	xml_symbols_t* xml_symbols_create(void)
+	{
+		return xml_symbols_create_ex(&xml__default_allocator);
+	}
+
+	xml_symbols_t* xml_symbols_create_ex(const xml_allocator_t* allocator)
+	{
+		xml_symbols_t* symbols = (xml_symbols_t*)xml__alloc(allocator, NULL, sizeof(xml_symbols_t));
+		if (symbols == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for xml symbols.");
+			exit(-1);
+		}
+
+		symbols->allocator = *allocator;
+		symbols->count = 0;
+		symbols->capacity = 16;
+		symbols->symbols = (struct xml__symbol*)xml__symbols_grow(symbols, NULL, symbols->capacity * sizeof(struct xml__symbol));
+		symbols->hashes = (uint32_t*)xml__symbols_grow(symbols, NULL, symbols->capacity * sizeof(uint32_t));
+		symbols->names_len = 0;
+		symbols->names_capacity = 256;
+		symbols->names = (char*)xml__symbols_grow(symbols, NULL, symbols->names_capacity);
+		symbols->slots = NULL;
+		xml__symbols_rehash(symbols, 32);
+
+		return symbols;
+	}
+
+	int xml_symbols_add(xml_symbols_t* symbols, const char* name)
+	{
+		return xml__symbols_intern(symbols, name, strlen(name), 1);
+	}
+
+	const char* xml_symbols_get_name(const xml_symbols_t* symbols, int id)
+	{
+		if (id <= 0 || (size_t)id > symbols->count) return NULL;
+		return &symbols->names[symbols->symbols[id - 1].offset];
+	}
+
+	void xml_symbols_free(xml_symbols_t* symbols)
+	{
+		xml_allocator_t allocator = symbols->allocator;
+		xml__dealloc(&allocator, symbols->slots);
+		xml__dealloc(&allocator, symbols->hashes);
+		xml__dealloc(&allocator, symbols->symbols);
+		xml__dealloc(&allocator, symbols->names);
+		xml__dealloc(&allocator, symbols);
+	}
+
+	static xml_symbols_t* xml__own_symbols(xml_t* xml)
+	{
+		if (xml->own_symbols == NULL) xml->own_symbols = xml_symbols_create_ex(&xml->allocator);
+		if (xml->symbols == NULL) xml->symbols = xml->own_symbols;
+		return xml->symbols;
+	}
+
+	int xml_get_name_id(xml_t* xml)
+	{
+		xml_strview_t name = xml_get_name_view(xml);
+		if (name.ptr == NULL) return 0;
+		if (xml->symbols == NULL) xml__own_symbols(xml);
+		return xml__symbols_intern(xml->symbols, name.ptr, name.len, xml->symbols == xml->own_symbols);
+	}
+
+	int xml_register_name(xml_t* xml, const char* name)
+	{
+		return xml_symbols_add(xml__own_symbols(xml), name);
+	}
+
+	void xml_set_symbols(xml_t* xml, xml_symbols_t* symbols)
+	{
+		xml->symbols = symbols != NULL ? symbols : xml->own_symbols;
 	}
 
 #undef STACK_SIZE
@@ -904,10 +4129,14 @@ extern "C" {
 #undef CALL
 #undef RET
 #undef TOK
+#undef XML__STAT
 #undef NEXTCH
 #undef FLAG_TRIM
 #undef FLAG_COLLAPSE
 #undef FLAG_PRESERVE
+#undef FLAG_LAZY
+#undef FLAG_DISCARD
+#undef POSTFIX_REFS
 #undef RET_COMMENT_OR_DOCTYPE
 #undef RET_TAG_END
 #undef RET_CDATA